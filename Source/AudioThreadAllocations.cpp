@@ -0,0 +1,111 @@
+#include "AudioThreadAllocations.h"
+
+#if JUCE_DEBUG
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+	thread_local int noAllocationScopes = 0;
+
+	void* allocate(std::size_t size)
+	{
+		checkAllocationAllowed();
+		return std::malloc(size != 0 ? size : 1);
+	}
+	void deallocate(void* ptr)
+	{
+		if (ptr != nullptr)
+			checkAllocationAllowed();
+		std::free(ptr);
+	}
+
+	// Aligned blocks have their own allocator on Windows, so they are freed through a different call
+	void* allocateAligned(std::size_t size, std::align_val_t alignment)
+	{
+		checkAllocationAllowed();
+		const auto align = juce::jmax(static_cast<std::size_t>(alignment), sizeof(void*));
+	   #if JUCE_WINDOWS
+		return _aligned_malloc(size != 0 ? size : 1, align);
+	   #else
+		void* ptr = nullptr;
+		return posix_memalign(&ptr, align, size != 0 ? size : 1) == 0 ? ptr : nullptr;
+	   #endif
+	}
+	void deallocateAligned(void* ptr)
+	{
+		if (ptr != nullptr)
+			checkAllocationAllowed();
+	   #if JUCE_WINDOWS
+		_aligned_free(ptr);
+	   #else
+		std::free(ptr);
+	   #endif
+	}
+}
+
+void checkAllocationAllowed()
+{
+	if (noAllocationScopes > 0)
+	{
+		// The assertion's own logging allocates, so lift the scope while it runs
+		const int scopes = noAllocationScopes;
+		noAllocationScopes = 0;
+		jassertfalse;
+		noAllocationScopes = scopes;
+	}
+}
+
+//==============================================================================
+// Every replaceable form is defined here rather than relying on the standard library to
+// forward the array, nothrow and aligned ones to the plain forms, which libstdc++ and MSVC
+// do not do for the aligned ones
+void* operator new(std::size_t size)
+{
+	if (void* ptr = allocate(size))
+		return ptr;
+	throw std::bad_alloc();
+}
+void* operator new[](std::size_t size)                                      { return operator new(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept        { return allocate(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept      { return allocate(size); }
+
+void operator delete(void* ptr) noexcept                                    { deallocate(ptr); }
+void operator delete[](void* ptr) noexcept                                  { deallocate(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept                       { deallocate(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept                     { deallocate(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept             { deallocate(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept           { deallocate(ptr); }
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+	if (void* ptr = allocateAligned(size, alignment))
+		return ptr;
+	throw std::bad_alloc();
+}
+void* operator new[](std::size_t size, std::align_val_t alignment)          { return operator new(size, alignment); }
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept   { return allocateAligned(size, alignment); }
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return allocateAligned(size, alignment); }
+
+void operator delete(void* ptr, std::align_val_t) noexcept                  { deallocateAligned(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept                { deallocateAligned(ptr); }
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept     { deallocateAligned(ptr); }
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept   { deallocateAligned(ptr); }
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept   { deallocateAligned(ptr); }
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { deallocateAligned(ptr); }
+#endif
+
+//==============================================================================
+ScopedNoAllocations::ScopedNoAllocations()
+{
+   #if JUCE_DEBUG
+	++noAllocationScopes;
+   #endif
+}
+
+ScopedNoAllocations::~ScopedNoAllocations()
+{
+   #if JUCE_DEBUG
+	--noAllocationScopes;
+   #endif
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+// In debug builds every form of the global operator new and delete, including the aligned
+// ones, asserts if it allocates or frees memory on a thread while a ScopedNoAllocations is
+// in scope. The processor holds one for each processBlock. Direct malloc calls, as in
+// juce::HeapBlock, are not caught unless they go through checkAllocationAllowed, as the
+// tinysoundfont hooks do.
+struct ScopedNoAllocations
+{
+	ScopedNoAllocations();
+	~ScopedNoAllocations();
+	JUCE_DECLARE_NON_COPYABLE(ScopedNoAllocations)
+};
+
+#if JUCE_DEBUG
+// Asserts if the calling thread is inside a ScopedNoAllocations
+void checkAllocationAllowed();
+#endif
@@ -0,0 +1,195 @@
+#include "MpeOutput.h"
+
+//==============================================================================
+MpeOutput::MpeOutput()
+{
+}
+
+void MpeOutput::reset(juce::MidiBuffer& output, int samplePosition)
+{
+	channels.fill(MemberChannel());
+	eventCounter = 0;
+	
+	// MPE configuration message: RPN 6 on the master channel sets the number of member
+	// channels, which also resets their pitch bend range to PITCH_BEND_RANGE
+	output.addEvent(juce::MidiMessage::controllerEvent(MASTER_CHANNEL, 101, 0), samplePosition);
+	output.addEvent(juce::MidiMessage::controllerEvent(MASTER_CHANNEL, 100, 6), samplePosition);
+	output.addEvent(juce::MidiMessage::controllerEvent(MASTER_CHANNEL, 6, NUM_MEMBER_CHANNELS), samplePosition);
+	
+	for (int member = 0; member < NUM_MEMBER_CHANNELS; ++member)
+		output.addEvent(juce::MidiMessage::pitchWheel(midiChannelOf(member), 8192), samplePosition);
+}
+
+void MpeOutput::releaseAll(juce::MidiBuffer& output, int samplePosition)
+{
+	for (int member = 0; member < NUM_MEMBER_CHANNELS; ++member)
+	{
+		auto& channel = channels[static_cast<size_t>(member)];
+		if (channel.note >= 0)
+			output.addEvent(juce::MidiMessage::noteOff(midiChannelOf(member), channel.note), samplePosition);
+		
+		channel = MemberChannel();
+	}
+}
+
+int MpeOutput::frequencyToPitchBend(int midiNote, double frequency)
+{
+	const double equalTempered = 440.0 * std::pow(2.0, (midiNote - 69) / 12.0);
+	const double offset = 12.0 * std::log2(juce::jmax(frequency, 1.0e-3) / equalTempered);
+	
+	return juce::jlimit(0, 16383, 8192 + juce::roundToInt(offset / PITCH_BEND_RANGE * 8192.0));
+}
+
+//==============================================================================
+void MpeOutput::addEvents(const juce::MidiBuffer& input, int startSample, int endSample,
+						  const std::array<double, 128>& noteFrequencies, juce::MidiBuffer& output)
+{
+	for (auto it = input.findNextSamplePosition(startSample); it != input.end(); ++it)
+	{
+		const auto metadata = *it;
+		if (metadata.samplePosition >= endSample)
+			break;
+		
+		const int samplePosition = metadata.samplePosition;
+		
+		// SysEx and the like pass through as raw bytes, a MidiMessage of them would allocate
+		if (metadata.numBytes > 3)
+		{
+			output.addEvent(metadata.data, metadata.numBytes, samplePosition);
+			continue;
+		}
+		
+		const auto message = metadata.getMessage();
+		
+		if (message.isNoteOn())
+		{
+			noteOn(message, noteFrequencies, output, samplePosition);
+		}
+		else if (message.isNoteOff())
+		{
+			// A note that started before MPE was switched on still ends where it began
+			if (!noteOff(message, output, samplePosition))
+				output.addEvent(message, samplePosition);
+		}
+		else if (message.isAftertouch())
+		{
+			// Polyphonic pressure becomes the channel pressure of the note's own channel
+			const int member = findChannelPlaying(message.getChannel(), message.getNoteNumber());
+			if (member >= 0)
+				output.addEvent(juce::MidiMessage::channelPressureChange(midiChannelOf(member), message.getAfterTouchValue()),
+								samplePosition);
+		}
+		else if (message.getChannel() > 0)
+		{
+			// Controllers, pitch wheel, channel pressure and program changes apply to the zone
+			auto zoneMessage = message;
+			zoneMessage.setChannel(MASTER_CHANNEL);
+			output.addEvent(zoneMessage, samplePosition);
+		}
+		else
+		{
+			output.addEvent(message, samplePosition);
+		}
+	}
+}
+
+void MpeOutput::retuneHeldNotes(const std::array<double, 128>& noteFrequencies, juce::MidiBuffer& output, int samplePosition)
+{
+	for (int member = 0; member < NUM_MEMBER_CHANNELS; ++member)
+	{
+		auto& channel = channels[static_cast<size_t>(member)];
+		if (channel.note < 0)
+			continue;
+		
+		const double frequency = noteFrequencies[static_cast<size_t>(channel.note)];
+		if (frequency <= 0.0)
+			continue;
+		
+		const int pitchBend = frequencyToPitchBend(channel.note, frequency);
+		if (pitchBend != channel.pitchBend)
+		{
+			channel.pitchBend = pitchBend;
+			output.addEvent(juce::MidiMessage::pitchWheel(midiChannelOf(member), pitchBend), samplePosition);
+		}
+	}
+}
+
+//==============================================================================
+void MpeOutput::noteOn(const juce::MidiMessage& message, const std::array<double, 128>& noteFrequencies,
+					   juce::MidiBuffer& output, int samplePosition)
+{
+	const int member = findChannelForNewNote();
+	auto& channel = channels[static_cast<size_t>(member)];
+	const int midiChannel = midiChannelOf(member);
+	
+	// Every channel busy: the oldest note makes way
+	if (channel.note >= 0)
+		output.addEvent(juce::MidiMessage::noteOff(midiChannel, channel.note), samplePosition);
+	
+	channel.inputChannel = message.getChannel();
+	channel.note = message.getNoteNumber();
+	channel.lastUsed = ++eventCounter;
+	
+	// The bend goes first, so the note starts in tune
+	const double frequency = noteFrequencies[static_cast<size_t>(channel.note)];
+	const int pitchBend = frequency > 0.0 ? frequencyToPitchBend(channel.note, frequency) : 8192;
+	
+	if (pitchBend != channel.pitchBend)
+	{
+		channel.pitchBend = pitchBend;
+		output.addEvent(juce::MidiMessage::pitchWheel(midiChannel, pitchBend), samplePosition);
+	}
+	
+	output.addEvent(juce::MidiMessage::noteOn(midiChannel, channel.note, message.getVelocity()), samplePosition);
+}
+
+bool MpeOutput::noteOff(const juce::MidiMessage& message, juce::MidiBuffer& output, int samplePosition)
+{
+	const int member = findChannelPlaying(message.getChannel(), message.getNoteNumber());
+	if (member < 0)
+		return false;
+	
+	auto& channel = channels[static_cast<size_t>(member)];
+	output.addEvent(juce::MidiMessage::noteOff(midiChannelOf(member), channel.note, message.getVelocity()), samplePosition);
+	
+	// The bend stays as it is, the note may still be releasing on the receiver
+	channel.inputChannel = 0;
+	channel.note = -1;
+	channel.lastUsed = ++eventCounter;
+	return true;
+}
+
+int MpeOutput::findChannelForNewNote() const
+{
+	int bestFree = -1;
+	int oldestBusy = 0;
+	
+	for (int member = 0; member < NUM_MEMBER_CHANNELS; ++member)
+	{
+		const auto& channel = channels[static_cast<size_t>(member)];
+		
+		if (channel.note < 0)
+		{
+			if (bestFree < 0 || channel.lastUsed < channels[static_cast<size_t>(bestFree)].lastUsed)
+				bestFree = member;
+		}
+		else if (channel.lastUsed < channels[static_cast<size_t>(oldestBusy)].lastUsed)
+		{
+			oldestBusy = member;
+		}
+	}
+	
+	return bestFree >= 0 ? bestFree : oldestBusy;
+}
+
+int MpeOutput::findChannelPlaying(int inputChannel, int note) const
+{
+	for (int member = 0; member < NUM_MEMBER_CHANNELS; ++member)
+	{
+		const auto& channel = channels[static_cast<size_t>(member)];
+		if (channel.note == note && channel.inputChannel == inputChannel)
+			return member;
+	}
+	
+	return -1;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+
+//==============================================================================
+/**
+ * MpeOutput - Sends the notes to external synths as MPE, each with its own tuning
+ *
+ * Uses the lower zone: channel 1 is the master channel and every note gets a member
+ * channel of its own (2 to 16), so a per-channel pitch bend can carry its offset
+ * from equal temperament. The bend is sent just before the note-on and again whenever
+ * the tuning of a held note changes. Everything works on fixed arrays, so nothing
+ * allocates on the audio thread.
+ */
+class MpeOutput
+{
+public:
+	//==============================================================================
+	static constexpr int MASTER_CHANNEL = 1;
+	static constexpr int FIRST_MEMBER_CHANNEL = 2;
+	static constexpr int NUM_MEMBER_CHANNELS = 15;
+	static constexpr double PITCH_BEND_RANGE = 48.0;   // Semitones, the MPE default for member channels
+	
+	MpeOutput();
+	
+	// Announces the zone to the receiver, after forgetting any notes held before
+	void reset(juce::MidiBuffer& output, int samplePosition);
+	
+	// Ends every held note, for when the output mode changes away from MPE
+	void releaseAll(juce::MidiBuffer& output, int samplePosition);
+	
+	// Rewrites the input events in [startSample, endSample) onto the zone. Notes move to
+	// member channels, channel-wide messages go to the master channel and anything else
+	// passes through unchanged. noteFrequencies holds the frequency of every MIDI note,
+	// 0 for notes left in equal temperament.
+	void addEvents(const juce::MidiBuffer& input, int startSample, int endSample,
+				   const std::array<double, 128>& noteFrequencies, juce::MidiBuffer& output);
+	
+	// Re-bends the held notes whose tuning changed
+	void retuneHeldNotes(const std::array<double, 128>& noteFrequencies, juce::MidiBuffer& output, int samplePosition);
+	
+	// The 14 bit pitch bend that moves an equal tempered note to frequency
+	static int frequencyToPitchBend(int midiNote, double frequency);
+
+private:
+	//==============================================================================
+	struct MemberChannel
+	{
+		int inputChannel = 0;      // The note as it arrived, 0 while the channel is free
+		int note = -1;
+		int pitchBend = 8192;      // Last bend sent on this channel
+		juce::uint32 lastUsed = 0; // When the note started, or ended once the channel is free
+	};
+	
+	void noteOn(const juce::MidiMessage& message, const std::array<double, 128>& noteFrequencies,
+				juce::MidiBuffer& output, int samplePosition);
+	bool noteOff(const juce::MidiMessage& message, juce::MidiBuffer& output, int samplePosition);
+	
+	// The free channel released longest ago, so release tails can finish and channels are
+	// used in turn, or when every channel is busy the one holding the oldest note
+	int findChannelForNewNote() const;
+	int findChannelPlaying(int inputChannel, int note) const;
+	
+	static int midiChannelOf(int member) { return FIRST_MEMBER_CHANNEL + member; }
+	
+	std::array<MemberChannel, NUM_MEMBER_CHANNELS> channels;
+	juce::uint32 eventCounter = 0;
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MpeOutput)
+};
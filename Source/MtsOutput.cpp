@@ -0,0 +1,89 @@
+#include "MtsOutput.h"
+
+//==============================================================================
+MtsOutput::MtsOutput()
+{
+	reset();
+}
+
+void MtsOutput::reset()
+{
+	for (auto& word : sentTuningWords)
+		word = NOT_SENT;
+}
+
+juce::uint32 MtsOutput::frequencyToTuningWord(double frequency)
+{
+	const double semitones = 69.0 + 12.0 * std::log2(juce::jmax(frequency, 1.0e-3) / 440.0);
+	
+	// Below note 0 or above the top of note 127 there is nothing closer to send
+	if (semitones <= 0.0)
+		return 0;
+	
+	int note = static_cast<int>(semitones);
+	int fraction = juce::roundToInt((semitones - note) * 16384.0);
+	
+	if (fraction == 16384)
+	{
+		++note;
+		fraction = 0;
+	}
+	
+	// 7f 7f 7f means "no change", so the top of note 127 stops one step short of it
+	if (note > 127 || (note == 127 && fraction > 16382))
+	{
+		note = 127;
+		fraction = 16382;
+	}
+	
+	return static_cast<juce::uint32>((note << 14) | fraction);
+}
+
+void MtsOutput::addTuningChanges(const std::array<double, 128>& noteFrequencies, juce::MidiBuffer& output, int samplePosition)
+{
+	int numNotes = 0;
+	
+	for (int note = 0; note < 128; ++note)
+	{
+		const double frequency = noteFrequencies[static_cast<size_t>(note)];
+		if (frequency <= 0.0)
+			continue;
+		
+		const auto word = frequencyToTuningWord(frequency);
+		if (word == sentTuningWords[static_cast<size_t>(note)])
+			continue;
+		
+		sentTuningWords[static_cast<size_t>(note)] = word;
+		
+		auto* bytes = message.data() + 7 + 4 * numNotes;
+		bytes[0] = static_cast<juce::uint8>(note);
+		bytes[1] = static_cast<juce::uint8>((word >> 14) & 0x7f);
+		bytes[2] = static_cast<juce::uint8>((word >> 7) & 0x7f);
+		bytes[3] = static_cast<juce::uint8>(word & 0x7f);
+		
+		if (++numNotes == MAX_NOTES_PER_MESSAGE)
+		{
+			addMessage(output, samplePosition, numNotes);
+			numNotes = 0;
+		}
+	}
+	
+	if (numNotes > 0)
+		addMessage(output, samplePosition, numNotes);
+}
+
+void MtsOutput::addMessage(juce::MidiBuffer& output, int samplePosition, int numNotes)
+{
+	// Universal real-time, MIDI tuning standard, single note tuning change, tuning program 0
+	message[0] = 0xf0;
+	message[1] = 0x7f;
+	message[2] = ALL_DEVICES;
+	message[3] = 0x08;
+	message[4] = 0x02;
+	message[5] = 0x00;
+	message[6] = static_cast<juce::uint8>(numNotes);
+	message[static_cast<size_t>(7 + 4 * numNotes)] = 0xf7;
+	
+	// Added from the raw bytes, a MidiMessage this long would allocate
+	output.addEvent(message.data(), 8 + 4 * numNotes, samplePosition);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+
+//==============================================================================
+/**
+ * MtsOutput - Sends the tuning to external synths as MIDI Tuning Standard SysEx
+ *
+ * Uses the real-time single note tuning change message, and remembers what each note
+ * was last sent as so only the notes whose tuning actually changed are sent again.
+ */
+class MtsOutput
+{
+public:
+	//==============================================================================
+	static constexpr int MAX_NOTES_PER_MESSAGE = 127;   // The count is a single data byte
+	static constexpr juce::uint8 ALL_DEVICES = 0x7f;
+	
+	MtsOutput();
+	
+	// Forgets what was sent, so the next update sends every note
+	void reset();
+	
+	// Adds tuning messages at samplePosition for the notes that differ from the last update.
+	// noteFrequencies holds the frequency of every MIDI note, 0 for notes left untuned.
+	void addTuningChanges(const std::array<double, 128>& noteFrequencies, juce::MidiBuffer& output, int samplePosition);
+	
+	// A frequency as the MTS three byte word: the semitone below it, then the distance above
+	// that semitone in 1/16384ths of a semitone. Packed as 7 bit bytes, high byte first.
+	static juce::uint32 frequencyToTuningWord(double frequency);
+
+private:
+	//==============================================================================
+	void addMessage(juce::MidiBuffer& output, int samplePosition, int numNotes);
+	
+	static constexpr juce::uint32 NOT_SENT = 0xffffffff;
+	std::array<juce::uint32, 128> sentTuningWords;
+	
+	// Header, then four bytes per note, then the end of exclusive byte
+	std::array<juce::uint8, 8 + 4 * MAX_NOTES_PER_MESSAGE> message;
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MtsOutput)
+};
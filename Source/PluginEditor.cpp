@@ -62,6 +62,16 @@ FluidJustIntonationEditor::FluidJustIntonationEditor (FluidJustIntonationProcess
 	sineWaveModeButton.setRadioGroupId(3);
 	addAndMakeVisible(sineWaveModeButton);
 	
+	wavetableModeButton.onClick = [this] { synthModeChanged(FluidJustIntonationSynth::SynthMode::Wavetable); };
+	wavetableModeButton.setRadioGroupId(3);
+	addAndMakeVisible(wavetableModeButton);
+	
+	waveformSelector.addItem("Saw", 1);
+	waveformSelector.addItem("Square", 2);
+	waveformSelector.addItem("Load WAV...", 3);
+	waveformSelector.onChange = [this] { waveformChanged(); };
+	addAndMakeVisible(waveformSelector);
+	
 	soundFontNameLabel.setText("No SoundFont loaded", juce::dontSendNotification);
 	soundFontNameLabel.setFont(juce::Font(juce::Font::getDefaultSansSerifFontName(), 14.0f, juce::Font::plain));
 	soundFontNameLabel.setJustificationType(juce::Justification::centredLeft);
@@ -81,6 +91,7 @@ FluidJustIntonationEditor::FluidJustIntonationEditor (FluidJustIntonationProcess
 	
 	// Update SoundFont UI state
 	updateSoundFontUI();
+	updateWaveformSelector();
 	
 	// Set the editor size (increased height for new controls)
 	setSize(700, 650);
@@ -172,11 +183,15 @@ void FluidJustIntonationEditor::resized()
 	
 	// First row: mode buttons and load button
 	auto sfRow1 = soundFontArea.removeFromTop(35);
-	sineWaveModeButton.setBounds(sfRow1.removeFromLeft(100));
+	sineWaveModeButton.setBounds(sfRow1.removeFromLeft(85));
+	sfRow1.removeFromLeft(10);
+	wavetableModeButton.setBounds(sfRow1.removeFromLeft(85));
+	sfRow1.removeFromLeft(5);
+	waveformSelector.setBounds(sfRow1.removeFromLeft(105));
 	sfRow1.removeFromLeft(10);
-	loadSoundFontButton.setBounds(sfRow1.removeFromLeft(120));
+	loadSoundFontButton.setBounds(sfRow1.removeFromLeft(115));
 	sfRow1.removeFromLeft(10);
-	unloadSoundFontButton.setBounds(sfRow1.removeFromLeft(80));
+	unloadSoundFontButton.setBounds(sfRow1.removeFromLeft(70));
 	sfRow1.removeFromLeft(10);
 	soundFontNameLabel.setBounds(sfRow1);
 	
@@ -321,6 +336,17 @@ void FluidJustIntonationEditor::timerCallback()
 		}
 	}
 	
+	// Refresh the SoundFont name once its samples have finished loading or a stream underran
+	const bool wasLoadingSamples = showingSampleLoading;
+	
+	if (showingSampleLoading != audioProcessor.isLoadingSoundFontSamples()
+		|| (audioProcessor.isSoundFontStreaming() && shownStreamUnderruns != audioProcessor.getSoundFontStreamUnderruns()))
+		updateSoundFontNameLabel();
+	
+	// Enable presets as their samples arrive, including the last ones
+	if (wasLoadingSamples)
+		updatePresetAvailability();
+	
 	// Trigger a repaint to update frequency display
 	repaint();
 }
@@ -461,6 +487,14 @@ void FluidJustIntonationEditor::unloadSoundFontClicked()
 void FluidJustIntonationEditor::presetChanged()
 {
 	int selectedPreset = presetSelector.getSelectedId() - 1; // ComboBox IDs are 1-based
+	
+	// A preset whose samples are still loading would play silence, keep the current one
+	if (selectedPreset >= 0 && !audioProcessor.isPresetLoaded(selectedPreset))
+	{
+		presetSelector.setSelectedId(audioProcessor.getCurrentPreset() + 1, juce::dontSendNotification);
+		return;
+	}
+	
 	if (selectedPreset >= 0)
 	{
 		audioProcessor.setPreset(selectedPreset);
@@ -470,8 +504,80 @@ void FluidJustIntonationEditor::presetChanged()
 void FluidJustIntonationEditor::synthModeChanged(FluidJustIntonationSynth::SynthMode mode)
 {
 	audioProcessor.setSynthMode(mode);
-	sineWaveModeButton.setToggleState(mode == FluidJustIntonationSynth::SynthMode::SineWave, 
-									  juce::dontSendNotification);
+	updateModeButtons();
+}
+
+void FluidJustIntonationEditor::updateModeButtons()
+{
+	auto mode = audioProcessor.getSynthMode();
+	sineWaveModeButton.setToggleState(mode == FluidJustIntonationSynth::SynthMode::SineWave, juce::dontSendNotification);
+	wavetableModeButton.setToggleState(mode == FluidJustIntonationSynth::SynthMode::Wavetable, juce::dontSendNotification);
+}
+
+//==============================================================================
+// Wavetable UI handlers
+
+void FluidJustIntonationEditor::waveformChanged()
+{
+	switch (waveformSelector.getSelectedId())
+	{
+		case 1: audioProcessor.setWavetable(Wavetable::createSaw()); break;
+		case 2: audioProcessor.setWavetable(Wavetable::createSquare()); break;
+		case 3: loadWavetableClicked(); return;
+		default: return;
+	}
+	
+	// Picking a waveform switches to the wavetable engine
+	synthModeChanged(FluidJustIntonationSynth::SynthMode::Wavetable);
+}
+
+void FluidJustIntonationEditor::loadWavetableClicked()
+{
+	fileChooser = std::make_unique<juce::FileChooser>(
+		"Select a single-cycle waveform...",
+		juce::File::getSpecialLocation(juce::File::userHomeDirectory),
+		"*.wav;*.aif;*.aiff;*.flac"
+	);
+	
+	auto fileChooserFlags = juce::FileBrowserComponent::openMode | 
+							juce::FileBrowserComponent::canSelectFiles;
+	
+	fileChooser->launchAsync(fileChooserFlags, [this](const juce::FileChooser& fc) {
+		auto file = fc.getResult();
+		
+		if (file.existsAsFile())
+		{
+			if (auto wavetable = Wavetable::createFromFile(file))
+			{
+				audioProcessor.setWavetable(std::move(wavetable));
+				synthModeChanged(FluidJustIntonationSynth::SynthMode::Wavetable);
+			}
+			else
+			{
+				juce::AlertWindow::showMessageBoxAsync(
+					juce::MessageBoxIconType::WarningIcon,
+					"Wavetable Error",
+					"Failed to load waveform file: " + file.getFileName() + " (must be an audio file of at most "
+						+ juce::String(Wavetable::MAX_IMPORT_SAMPLES) + " samples)"
+				);
+			}
+		}
+		
+		// Show the table in use, also when the chooser was cancelled
+		updateWaveformSelector();
+	});
+}
+
+void FluidJustIntonationEditor::updateWaveformSelector()
+{
+	auto name = audioProcessor.getWavetableName();
+	
+	if (audioProcessor.getWavetableFile() == juce::File() && name == "Square")
+		waveformSelector.setSelectedId(2, juce::dontSendNotification);
+	else if (audioProcessor.getWavetableFile() == juce::File())
+		waveformSelector.setSelectedId(1, juce::dontSendNotification);
+	else
+		waveformSelector.setText(name, juce::dontSendNotification);
 }
 
 void FluidJustIntonationEditor::updateSoundFontUI()
@@ -480,31 +586,48 @@ void FluidJustIntonationEditor::updateSoundFontUI()
 	
 	unloadSoundFontButton.setEnabled(loaded);
 	// presetSelector.setEnabled(loaded);
+	updateSoundFontNameLabel();
+	
+	if (!loaded)
+		presetSelector.clear();
 	
-	if (loaded)
+	// Loading switches to SoundFont mode, unloading back to sine wave mode
+	updateModeButtons();
+}
+
+void FluidJustIntonationEditor::updateSoundFontNameLabel()
+{
+	showingSampleLoading = audioProcessor.isLoadingSoundFontSamples();
+	shownStreamUnderruns = audioProcessor.getSoundFontStreamUnderruns();
+	
+	if (audioProcessor.isSoundFontLoaded())
 	{
-		soundFontNameLabel.setText(audioProcessor.getSoundFontName(), juce::dontSendNotification);
-		soundFontNameLabel.setColour(juce::Label::textColourId, successColour);
+		juce::String status;
 		
-		// Auto-switch to SoundFont mode
-		sineWaveModeButton.setToggleState(false, juce::dontSendNotification);
+		if (showingSampleLoading)
+			status = " (loading samples...)";
+		else if (audioProcessor.isSoundFontStreaming())
+			status = " (streaming, " + juce::String(shownStreamUnderruns) + " underruns)";
+		
+		soundFontNameLabel.setText(audioProcessor.getSoundFontName() + status, juce::dontSendNotification);
+		soundFontNameLabel.setColour(juce::Label::textColourId, showingSampleLoading || shownStreamUnderruns > 0 ? textColour : successColour);
 	}
 	else
 	{
 		soundFontNameLabel.setText("No SoundFont loaded", juce::dontSendNotification);
 		soundFontNameLabel.setColour(juce::Label::textColourId, textColour.withAlpha(0.7f));
-		presetSelector.clear();
-		
-		// Switch back to sine wave mode
-		sineWaveModeButton.setToggleState(true, juce::dontSendNotification);
 	}
 }
 
 void FluidJustIntonationEditor::updatePresetList()
 {
-	// presetSelector.clear();
+	presetSelector.clear(juce::dontSendNotification);
 	
 	int presetCount = audioProcessor.getPresetCount();
+	int currentPreset = audioProcessor.getCurrentPreset();
+	
+	// Channel 10 starts on the bank's drum kit rather than the selected preset
+	int drumPreset = audioProcessor.getChannelPreset(9);
 	
 	for (int i = 0; i < presetCount; ++i)
 	{
@@ -512,14 +635,25 @@ void FluidJustIntonationEditor::updatePresetList()
 		if (presetName.isEmpty())
 			presetName = "Preset " + juce::String(i);
 		
+		if (i == drumPreset && drumPreset != currentPreset)
+			presetName += " (channel 10)";
+		
 		presetSelector.addItem(juce::String(i) + ": " + presetName, i + 1);
 	}
 	
+	updatePresetAvailability();
+	
 	// Select the current preset
-	int currentPreset = audioProcessor.getCurrentPreset();
 	presetSelector.setSelectedId(currentPreset + 1, juce::dontSendNotification);
 }
 
+void FluidJustIntonationEditor::updatePresetAvailability()
+{
+	// Presets whose samples are still loading can't be chosen yet
+	for (int i = 0; i < presetSelector.getNumItems(); ++i)
+		presetSelector.setItemEnabled(i + 1, audioProcessor.isPresetLoaded(i));
+}
+
 //==============================================================================
 
 void FluidJustIntonationEditor::drawFrequencyDisplay(juce::Graphics& g, juce::Rectangle<int> area)
@@ -540,8 +674,11 @@ void FluidJustIntonationEditor::drawFrequencyDisplay(juce::Graphics& g, juce::Re
 	const int startNote = 72; // C5
 	const int numNotes = 12;
 	
+	// One copy of the tuning the audio thread last used, so every note comes from the same block
+	const auto tuning = audioProcessor.getTuningSnapshot();
+	
 	// Get current root for highlighting
-	int currentRoot = audioProcessor.getMeasureRoot(audioProcessor.getCurrentMeasure());
+	int currentRoot = tuning.root;
 	int rootNoteIndex = currentRoot % 12;
 	
 	// Calculate layout
@@ -554,7 +691,7 @@ void FluidJustIntonationEditor::drawFrequencyDisplay(juce::Graphics& g, juce::Re
 		int noteIndex = i; // 0 = C, 1 = C#, etc.
 		
 		// Get the frequency for this note from the processor
-		double frequency = audioProcessor.getFrequencyForNote(midiNote);
+		double frequency = tuning.frequencies[static_cast<size_t>(midiNote)];
 		
 		// Calculate position
 		float x = area.getX() + i * noteWidth;
@@ -140,9 +140,13 @@ private:
 	juce::TextButton loadSoundFontButton { "Load SoundFont" };
 	juce::TextButton unloadSoundFontButton { "Unload" };
 	juce::TextButton sineWaveModeButton { "Sine Wave" };
+	juce::TextButton wavetableModeButton { "Wavetable" };
+	juce::ComboBox waveformSelector;
 	juce::Label soundFontNameLabel;
 	juce::ComboBox presetSelector;
 	juce::Label presetLabel { {}, "Preset:" };
+	bool showingSampleLoading = false;   // Name label shows that samples are still loading
+	int shownStreamUnderruns = 0;        // Underruns in the name label of a streamed SoundFont
 	
 	// Visualization of the just intonation scale
 	juce::DrawableRectangle pianoRoll;
@@ -161,12 +165,20 @@ private:
 	void presetChanged();
 	void synthModeChanged(FluidJustIntonationSynth::SynthMode mode);
 	
+	// Wavetable event handlers
+	void waveformChanged();
+	void loadWavetableClicked();
+	
 	// Update the UI based on current sequence length
 	void updateMeasureRootSelectors();
 	
 	// Update SoundFont UI state
 	void updateSoundFontUI();
+	void updateSoundFontNameLabel();
 	void updatePresetList();
+	void updatePresetAvailability();
+	void updateModeButtons();
+	void updateWaveformSelector();
 	
 	// File chooser for soundfont loading
 	std::unique_ptr<juce::FileChooser> fileChooser;
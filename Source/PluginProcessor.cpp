@@ -1,5 +1,6 @@
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
+#include "AudioThreadAllocations.h"
 
 #ifndef JucePlugin_Name
 #define JucePlugin_Name "Flooid"
@@ -20,15 +21,34 @@ FluidJustIntonationProcessor::FluidJustIntonationProcessor()
 			std::make_unique<juce::AudioParameterChoice> ("sequenceLength", "Sequence Length", 
 														  juce::StringArray {"4", "8", "12", "16"}, 0),
 			std::make_unique<juce::AudioParameterChoice> ("intonationMode", "Intonation Mode", 
-														  juce::StringArray {"Set", "Shift"}, 0)
+														  juce::StringArray {"Set", "Shift"}, 0),
+			std::make_unique<juce::AudioParameterInt> ("polyphony", "Sine Polyphony",
+													   1, FluidJustIntonationSynth::MAX_SINE_VOICES, 16),
+			std::make_unique<juce::AudioParameterFloat> ("retuneGlide", "Retune Glide (ms)",
+														 0.0f, static_cast<float>(FluidJustIntonationSynth::MAX_RETUNE_GLIDE_MS), 0.0f),
+			std::make_unique<juce::AudioParameterChoice> ("tuningOutput", "Tuning Output",
+														  juce::StringArray {"Off", "MTS SysEx", "MPE"}, 0),
+			std::make_unique<juce::AudioParameterChoice> ("controlBlockSize", "Control Block Size",
+														  juce::StringArray {"Auto", "16", "32", "64", "128"}, 0),
+			std::make_unique<juce::AudioParameterBool> ("diskStreaming", "SoundFont Disk Streaming", false),
+			std::make_unique<juce::AudioParameterBool> ("bankCache", "SoundFont Cache", true),
+			std::make_unique<juce::AudioParameterBool> ("sampleMipmaps", "SoundFont Sample Mipmaps", false),
+			std::make_unique<juce::AudioParameterInt> ("soundFontPolyphony", "SoundFont Voices",
+													   SoundFontPlayer::MIN_POLYPHONY, SoundFontPlayer::MAX_POLYPHONY,
+													   SoundFontPlayer::DEFAULT_POLYPHONY)
 		})
 {
 
 	// Initialize measure roots to C (MIDI note 60)
 	for (int i = 0; i < MAX_SEQUENCE_LENGTH; i++) {
 		measureRoots[i] = 60; // Middle C
+		pendingMeasureRoots[i] = 60;
 	}
 	
+	// The editor shows the default tuning until the first block publishes one
+	for (int note = 0; note < 128; ++note)
+		uiFrequencies[static_cast<size_t>(note)] = midiNoteToFrequency(note);
+	
 	// Add parameters for each possible measure root (up to MAX_SEQUENCE_LENGTH)
 	for (int i = 0; i < MAX_SEQUENCE_LENGTH; i++) {
 		juce::String paramID = "measureRoot" + juce::String(i);
@@ -50,11 +70,21 @@ FluidJustIntonationProcessor::FluidJustIntonationProcessor()
 	// Add listeners for sequence length and mode
 	parameters.addParameterListener("sequenceLength", this);
 	parameters.addParameterListener("intonationMode", this);
+	parameters.addParameterListener("polyphony", this);
+	parameters.addParameterListener("retuneGlide", this);
+	parameters.addParameterListener("tuningOutput", this);
+	parameters.addParameterListener("controlBlockSize", this);
+	parameters.addParameterListener("diskStreaming", this);
+	parameters.addParameterListener("bankCache", this);
+	parameters.addParameterListener("sampleMipmaps", this);
+	parameters.addParameterListener("soundFontPolyphony", this);
 	
+	startTimer(100);
 }
 
 FluidJustIntonationProcessor::~FluidJustIntonationProcessor()
 {
+	stopTimer();
 }
 //==============================================================================
 const juce::String FluidJustIntonationProcessor::getName() const
@@ -97,7 +127,9 @@ bool FluidJustIntonationProcessor::isSynth() const
 
 double FluidJustIntonationProcessor::getTailLengthSeconds() const
 {
-	return 0.0;
+	// Report a release tail so hosts with smart-disable (FL Studio) don't put us
+	// to sleep while notes are still ringing out
+	return RELEASE_TAIL_SECONDS;
 }
 
 int FluidJustIntonationProcessor::getNumPrograms()
@@ -134,9 +166,24 @@ void FluidJustIntonationProcessor::prepareToPlay (double sampleRate, int samples
 	// Initialize the synthesizer
 	synth.setup(sampleRate, samplesPerBlock);
 	
-	// Initialize with the current tuning
+	// Room for a full retune of every note plus the incoming events, so the
+	// buffers don't grow on the audio thread
+	tuningMessages.ensureSize(8192);
+	mergedMidi.ensureSize(8192);
+	
+	// Initialize with the current tuning, sending all of it to the output again. The MPE
+	// zone is announced again too and notes held before are forgotten, as the host stops
+	// playback around this call.
+	tuningMessages.clear();
+	mtsOutput.reset();
+	
+	if (tuningOutput == TuningOutput::Mpe)
+		mpeOutput.reset(tuningMessages, 0);
+	
+	applyPendingParameters();
 	updateCurrentMeasure(getPlayHead());
 	updateFrequencyMap();
+	publishUiSnapshot();
 	
 }
 
@@ -170,12 +217,8 @@ bool FluidJustIntonationProcessor::isBusesLayoutSupported (const BusesLayout& la
 
 void FluidJustIntonationProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
-	static bool firstProcessBlock = true;
-	if (firstProcessBlock) {
-		firstProcessBlock = false;
-	}
-
 	juce::ScopedNoDenormals noDenormals;
+	ScopedNoAllocations noAllocations;
 	auto totalNumInputChannels  = getTotalNumInputChannels();
 	auto totalNumOutputChannels = getTotalNumOutputChannels();
 
@@ -183,33 +226,85 @@ void FluidJustIntonationProcessor::processBlock (juce::AudioBuffer<float>& buffe
 	for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
 		buffer.clear (i, 0, buffer.getNumSamples());
 
+	// Take any parameter changes made since the last block, before the measure is worked
+	// out so a shorter sequence applies straight away
+	applyPendingParameters();
+	
 	// Get playback position and update current measure
+	// (kept up to date while idle so Shift mode still sees every loop transition)
 	updateCurrentMeasure(getPlayHead());
 	
-	// Update the frequency map if the measure has changed
-	updateFrequencyMap();
+	const int numSamples = buffer.getNumSamples();
+	
+	// Recompile the tuning once if anything it depends on changed. Done while idle too so
+	// the editor's copy follows the controls.
+	if (frequencyMapDirty)
+		updateFrequencyMap();
 	
-	// Process MIDI through the synthesizer
-	synth.renderNextBlock(buffer, midiMessages, 0, buffer.getNumSamples());
+	// Idle fast path: no sounding voices and no incoming MIDI means nothing to render.
+	// clear() flags the buffer as silent, which the plugin wrappers report to the host.
+	// FL Studio keeps us awake through the tail length and wakes us again on MIDI input.
+	// External synths may still be sounding, so tuning output carries on while idle, and
+	// messages already queued (the note-offs sent when MPE output is switched off) still go out.
+	const bool idle = midiMessages.isEmpty() && !synth.isActive();
 	
-	// Important: if the synth is silent, add a small amount of noise
-	// This helps FL Studio recognize it's actually processing audio
-	if (buffer.getRMSLevel(0, 0, buffer.getNumSamples()) < 0.000001f)
+	if (idle)
 	{
-		// Add extremely quiet noise (below -120dB)
-		float* leftChannel = buffer.getWritePointer(0);
-		float* rightChannel = totalNumOutputChannels > 1 ? buffer.getWritePointer(1) : nullptr;
+		buffer.clear();
 		
-		for (int i = 0; i < buffer.getNumSamples(); ++i)
+		if (tuningOutput == TuningOutput::Off && tuningMessages.isEmpty())
 		{
-			// Extremely quiet random noise
-			float noise = ((juce::Random::getSystemRandom().nextFloat() * 2.0f) - 1.0f) * 0.0000001f;
-			leftChannel[i] += noise;
-			
-			if (rightChannel != nullptr)
-				rightChannel[i] += noise;
+			publishUiSnapshot();
+			return;
 		}
 	}
+	
+	// A bar line inside the block splits it, so the new measure's tuning starts on the bar
+	const int barLineSample = samplesToNextBar > 0.0 ? static_cast<int>(std::ceil(samplesToNextBar)) : -1;
+	
+	if (barLineSample > 0 && barLineSample < numSamples)
+	{
+		renderRange(buffer, midiMessages, 0, barLineSample, idle);
+		moveToMeasure(nextBarMeasure);
+		
+		if (frequencyMapDirty)
+			updateFrequencyMap(barLineSample);
+		
+		renderRange(buffer, midiMessages, barLineSample, numSamples - barLineSample, idle);
+	}
+	else
+	{
+		renderRange(buffer, midiMessages, 0, numSamples, idle);
+	}
+	
+	if (tuningOutput == TuningOutput::Mpe)
+	{
+		// The notes were rewritten onto the MPE zone, in order with their bends
+		midiMessages.swapWith(tuningMessages);
+		tuningMessages.clear();
+	}
+	else if (!tuningMessages.isEmpty())
+	{
+		// Incoming MIDI passes through to the output, with tuning changes ahead of any
+		// notes at the same position so those notes already sound in tune
+		mergedMidi.clear();
+		mergedMidi.addEvents(tuningMessages, 0, -1, 0);
+		mergedMidi.addEvents(midiMessages, 0, -1, 0);
+		midiMessages.swapWith(mergedMidi);
+		tuningMessages.clear();
+	}
+	
+	publishUiSnapshot();
+}
+
+void FluidJustIntonationProcessor::renderRange(juce::AudioBuffer<float>& buffer, const juce::MidiBuffer& midiMessages,
+											   int startSample, int numSamples, bool idle)
+{
+	if (!idle)
+		synth.renderNextBlock(buffer, midiMessages, startSample, numSamples);
+	
+	if (tuningOutput == TuningOutput::Mpe)
+		mpeOutput.addEvents(midiMessages, startSample, startSample + numSamples, currentFrequencyMap, tuningMessages);
 }
 
 //==============================================================================
@@ -237,6 +332,15 @@ void FluidJustIntonationProcessor::getStateInformation (juce::MemoryBlock& destD
 		xml->setAttribute("soundFontPreset", getCurrentPreset());
 	}
 	
+	// The wavetable by file, or by name for the built-in ones
+	if (getWavetableFile() != juce::File())
+		xml->setAttribute("wavetablePath", getWavetableFile().getFullPathName());
+	else
+		xml->setAttribute("wavetable", getWavetableName());
+	
+	if (getSynthMode() == FluidJustIntonationSynth::SynthMode::Wavetable)
+		xml->setAttribute("synthMode", "wavetable");
+	
 	copyXmlToBinary(*xml, destData);
 }
 
@@ -264,6 +368,17 @@ void FluidJustIntonationProcessor::setStateInformation (const void* data, int si
 				}
 			}
 		}
+		
+		// Restore the wavetable, a file that can no longer be read keeps the current one
+		juce::String wavetablePath = xmlState->getStringAttribute("wavetablePath", "");
+		juce::String wavetableName = xmlState->getStringAttribute("wavetable", "Saw");
+		if (wavetablePath.isNotEmpty())
+			setWavetable(Wavetable::createFromFile(juce::File(wavetablePath)));
+		else if (wavetableName != getWavetableName() || getWavetableFile() != juce::File())
+			setWavetable(wavetableName == "Square" ? Wavetable::createSquare() : Wavetable::createSaw());
+		
+		if (xmlState->getStringAttribute("synthMode") == "wavetable")
+			setSynthMode(FluidJustIntonationSynth::SynthMode::Wavetable);
 	}
 }
 
@@ -292,6 +407,46 @@ void FluidJustIntonationProcessor::parameterChanged(const juce::String& paramete
 		
 		setIntonationMode(mode);
 	}
+	else if (parameterID == "polyphony") {
+		pendingPolyphony = static_cast<int>(newValue);
+		parametersChanged = true;
+	}
+	else if (parameterID == "retuneGlide") {
+		pendingRetuneGlideMs = newValue;
+		parametersChanged = true;
+	}
+	else if (parameterID == "tuningOutput") {
+		TuningOutput output = TuningOutput::Off;
+		if (newValue == 1.0f)
+			output = TuningOutput::MtsSysEx;
+		else if (newValue == 2.0f)
+			output = TuningOutput::Mpe;
+		
+		pendingTuningOutput = output;
+		parametersChanged = true;
+	}
+	else if (parameterID == "controlBlockSize") {
+		// Auto, then 16, 32, 64 and 128 samples
+		const int choice = static_cast<int>(newValue);
+		pendingControlBlockSize = choice > 0 ? 8 << choice : 0;
+		parametersChanged = true;
+	}
+	else if (parameterID == "diskStreaming") {
+		// Only stored, the next SoundFont load reads it
+		synth.setSoundFontDiskStreaming(newValue >= 0.5f);
+	}
+	else if (parameterID == "bankCache") {
+		// Read at the next load, turning it off also stops a cache being written
+		synth.setSoundFontBankCache(newValue >= 0.5f);
+	}
+	else if (parameterID == "soundFontPolyphony") {
+		// Picked up by timerCallback
+		pendingSoundFontPolyphony = static_cast<int>(newValue);
+	}
+	else if (parameterID == "sampleMipmaps") {
+		// Built in the background for the loaded bank, disabling it applies from the next load
+		synth.setSoundFontSampleMipmaps(newValue >= 0.5f);
+	}
 	else if (parameterID.startsWith("measureRoot")) {
 		// Extract the measure index from the parameter ID
 		int measureIndex = parameterID.getTrailingIntValue();
@@ -302,72 +457,139 @@ void FluidJustIntonationProcessor::parameterChanged(const juce::String& paramete
 		
 		setMeasureRoot(measureIndex, midiNote);
 	}
+}
+
+void FluidJustIntonationProcessor::applyPendingParameters()
+{
+	// A change recorded after this point sets the flag again and is picked up next block
+	if (!parametersChanged.exchange(false))
+		return;
+	
+	const int length = pendingSequenceLength;
+	if (length != sequenceLength)
+	{
+		// Reset drift when sequence length changes
+		resetAccumulatedDrift();
+		sequenceLength = length;
+	}
 	
-	// Update the frequency mapping
-	updateFrequencyMap();
+	const IntonationMode mode = pendingIntonationMode;
+	if (mode != intonationMode)
+	{
+		// Reset drift when switching from Shift to Set
+		if (mode == IntonationMode::Set)
+			resetAccumulatedDrift();
+		intonationMode = mode;
+		frequencyMapDirty = true;
+	}
+	
+	for (int i = 0; i < MAX_SEQUENCE_LENGTH; ++i)
+	{
+		const int root = pendingMeasureRoots[i];
+		if (root != measureRoots[i])
+		{
+			measureRoots[i] = root;
+			frequencyMapDirty = true;
+		}
+	}
+	
+	// Voices are preallocated, so none of these allocates
+	if (pendingPolyphony != synth.getMaxPolyphony())
+		synth.setMaxPolyphony(pendingPolyphony);
+	
+	if (static_cast<double>(pendingRetuneGlideMs) != synth.getRetuneGlideTime())
+		synth.setRetuneGlideTime(pendingRetuneGlideMs);
+	
+	if (pendingControlBlockSize != synth.getControlBlockSize())
+		synth.setControlBlockSize(pendingControlBlockSize);
+	
+	const TuningOutput output = pendingTuningOutput;
+	if (output != tuningOutput)
+	{
+		// Notes held on MPE member channels would never see their note-offs otherwise
+		if (tuningOutput == TuningOutput::Mpe)
+			mpeOutput.releaseAll(tuningMessages, 0);
+		
+		// Whatever the receiver was last sent is unknown, so start with every note
+		tuningOutput = output;
+		mtsOutput.reset();
+		
+		if (tuningOutput == TuningOutput::Mpe)
+			mpeOutput.reset(tuningMessages, 0);
+		
+		frequencyMapDirty = true;
+	}
+}
+
+void FluidJustIntonationProcessor::timerCallback()
+{
+	const int voices = pendingSoundFontPolyphony;
+	
+	if (voices != synth.getSoundFontPolyphony())
+		synth.setSoundFontPolyphony(voices);
 }
 
 // Just Intonation Implementation
 
 // Function to update the frequency map based on current settings
-void FluidJustIntonationProcessor::updateFrequencyMap()
+void FluidJustIntonationProcessor::updateFrequencyMap(int samplePosition)
 {
-	// Clear the current mapping
-	currentFrequencyMap.clear();
+	frequencyMapDirty = false;
+	uiSnapshotDirty = true;
 	
 	// Generate frequencies for all MIDI notes
 	for (int note = 0; note < 128; ++note) {
 		double freq = midiNoteToFrequency(note);
-		currentFrequencyMap[note] = freq;
+		currentFrequencyMap[static_cast<size_t>(note)] = freq;
 	}
 	
 	// Update the synthesizer with the new mapping
 	synth.updateFrequencyMapping(currentFrequencyMap);
+	
+	if (tuningOutput == TuningOutput::MtsSysEx)
+		mtsOutput.addTuningChanges(currentFrequencyMap, tuningMessages, samplePosition);
+	else if (tuningOutput == TuningOutput::Mpe)
+		mpeOutput.retuneHeldNotes(currentFrequencyMap, tuningMessages, samplePosition);
 }
 
 void FluidJustIntonationProcessor::setSequenceLength(int length)
 {
 	if (length == 4 || length == 8 || length == 12 || length == 16)
 	{
-		if (length != sequenceLength)
-		{
-			// Reset drift when sequence length changes
-			resetAccumulatedDrift();
-		}
-		sequenceLength = length;
+		pendingSequenceLength = length;
+		parametersChanged = true;
 	}
 }
 
 int FluidJustIntonationProcessor::getSequenceLength() const
 {
-	return sequenceLength;
+	return pendingSequenceLength;
 }
 
 void FluidJustIntonationProcessor::setIntonationMode(IntonationMode mode)
 {
-	if (mode == IntonationMode::Set && intonationMode == IntonationMode::Shift)
-	{
-		// Reset drift when switching from Shift to Set
-		resetAccumulatedDrift();
-	}
-	intonationMode = mode;
+	pendingIntonationMode = mode;
+	parametersChanged = true;
 }
 
 FluidJustIntonationProcessor::IntonationMode FluidJustIntonationProcessor::getIntonationMode() const
 {
-	return intonationMode;
+	return pendingIntonationMode;
 }
 
 void FluidJustIntonationProcessor::setMeasureRoot(int measureIndex, int rootNote)
 {
 	if (measureIndex >= 0 && measureIndex < MAX_SEQUENCE_LENGTH)
-		measureRoots[measureIndex] = rootNote;
+	{
+		pendingMeasureRoots[measureIndex] = rootNote;
+		parametersChanged = true;
+	}
 }
 
 int FluidJustIntonationProcessor::getMeasureRoot(int measureIndex) const
 {
 	if (measureIndex >= 0 && measureIndex < MAX_SEQUENCE_LENGTH)
-		return measureRoots[measureIndex];
+		return pendingMeasureRoots[measureIndex];
 	
 	return 60; // Default to middle C
 }
@@ -536,6 +758,8 @@ double FluidJustIntonationProcessor::midiNoteToFrequency(int midiNote)
 
 void FluidJustIntonationProcessor::updateCurrentMeasure(juce::AudioPlayHead* playHead)
 {
+	samplesToNextBar = -1.0;
+	
 	if (playHead == nullptr)
 		return;
 		
@@ -564,25 +788,39 @@ void FluidJustIntonationProcessor::updateCurrentMeasure(juce::AudioPlayHead* pla
 			
 			// Calculate current measure (assuming 4/4 time signature)
 			int measuresPassed = static_cast<int>(ppqPosition / 4.0); // 4 beats per measure
-			int newMeasure = measuresPassed % sequenceLength;
+			moveToMeasure(measuresPassed % sequenceLength);
 			
-			// Detect loop transition (going from last measure to first)
-			if (intonationMode == IntonationMode::Shift && 
-				previousMeasure == sequenceLength - 1 && 
-				newMeasure == 0 && 
-				previousMeasure != -1)
+			// Where the next bar line falls, processBlock moves to that measure right on it
+			if (isPlaying && bpm > 0.0)
 			{
-				// Store the frequency of the last measure's root for the next loop
-				accumulatedDriftFrequency = getCurrentMeasureRootFrequencyForMeasure(sequenceLength - 1);
-				hasAccumulatedDrift = true;
+				samplesToNextBar = ((measuresPassed + 1) * 4.0 - ppqPosition) * 60.0 / bpm * getSampleRate();
+				nextBarMeasure = (measuresPassed + 1) % sequenceLength;
 			}
-			
-			previousMeasure = currentMeasure;
-			currentMeasure = newMeasure;
 		}
 	}
 }
 
+void FluidJustIntonationProcessor::moveToMeasure(int newMeasure)
+{
+	// Detect loop transition (going from last measure to first). Only the block that
+	// crosses the loop point sees the last measure as current, so drift is added once.
+	if (intonationMode == IntonationMode::Shift && 
+		currentMeasure == sequenceLength - 1 && 
+		newMeasure == 0 && 
+		previousMeasure != -1)
+	{
+		// Store the frequency of the last measure's root for the next loop
+		accumulatedDriftFrequency = getCurrentMeasureRootFrequencyForMeasure(sequenceLength - 1);
+		hasAccumulatedDrift = true;
+	}
+	
+	if (newMeasure != currentMeasure)
+		frequencyMapDirty = true;
+	
+	previousMeasure = currentMeasure;
+	currentMeasure = newMeasure;
+}
+
 //==============================================================================
 // Drift management
 
@@ -590,131 +828,67 @@ void FluidJustIntonationProcessor::resetAccumulatedDrift()
 {
 	accumulatedDriftFrequency = 0.0;
 	hasAccumulatedDrift = false;
+	frequencyMapDirty = true;
 }
 
-double FluidJustIntonationProcessor::getFrequencyForNote(int midiNote) const
+//==============================================================================
+// Editor snapshot
+
+void FluidJustIntonationProcessor::publishUiSnapshot()
 {
-	// This is a const version for the UI to query frequencies
-	// We need to calculate based on current state without modifying anything
+	if (!uiSnapshotDirty)
+		return;
 	
-	// Get the root frequency for the current measure
-	int currentRoot = measureRoots[currentMeasure];
-	double rootFreq;
+	uiSnapshotDirty = false;
 	
-	if (intonationMode == IntonationMode::Set) {
-		if (currentMeasure == 0) {
-			rootFreq = CONCERT_A_FREQ * std::pow(2.0, (currentRoot - 69) / 12.0);
-		}
-		else {
-			int measure0Root = measureRoots[0];
-			double measure0RootFreq = CONCERT_A_FREQ * std::pow(2.0, (measure0Root - 69) / 12.0);
-			
-			// Calculate current root in measure 0's scale
-			int semitoneDistance = currentRoot - measure0Root;
-			int octaves = semitoneDistance / 12;
-			int intervalWithinOctave = semitoneDistance % 12;
-			if (intervalWithinOctave < 0) {
-				intervalWithinOctave += 12;
-				octaves -= 1;
-			}
-			
-			static const std::array<double, 12> justRatios = {
-				1.0, 16.0/15.0, 9.0/8.0, 6.0/5.0, 5.0/4.0, 4.0/3.0,
-				45.0/32.0, 3.0/2.0, 8.0/5.0, 5.0/3.0, 9.0/5.0, 15.0/8.0
-			};
-			
-			double ratio = justRatios[intervalWithinOctave] * std::pow(2.0, octaves);
-			rootFreq = measure0RootFreq * ratio;
-		}
-	}
-	else {
-		// Shift mode - need to calculate iteratively
-		if (currentMeasure == 0 && hasAccumulatedDrift) {
-			int lastMeasureRoot = measureRoots[sequenceLength - 1];
-			int semitoneDistance = currentRoot - lastMeasureRoot;
-			int octaves = semitoneDistance / 12;
-			int intervalWithinOctave = semitoneDistance % 12;
-			if (intervalWithinOctave < 0) {
-				intervalWithinOctave += 12;
-				octaves -= 1;
-			}
+	// Seqlock write, the audio thread never waits on the editor
+	const uint32_t sequence = uiSnapshotSequence.load(std::memory_order_relaxed);
+	uiSnapshotSequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	
+	uiMeasure.store(currentMeasure, std::memory_order_relaxed);
+	uiRoot.store(measureRoots[currentMeasure], std::memory_order_relaxed);
+	
+	for (size_t note = 0; note < uiFrequencies.size(); ++note)
+		uiFrequencies[note].store(currentFrequencyMap[note], std::memory_order_relaxed);
+	
+	uiSnapshotSequence.store(sequence + 2, std::memory_order_release);
+}
+
+FluidJustIntonationProcessor::TuningSnapshot FluidJustIntonationProcessor::getTuningSnapshot() const
+{
+	TuningSnapshot snapshot;
+	
+	for (;;)
+	{
+		const uint32_t sequence = uiSnapshotSequence.load(std::memory_order_acquire);
+		
+		if ((sequence & 1) == 0)
+		{
+			snapshot.measure = uiMeasure.load(std::memory_order_relaxed);
+			snapshot.root = uiRoot.load(std::memory_order_relaxed);
 			
-			static const std::array<double, 12> justRatios = {
-				1.0, 16.0/15.0, 9.0/8.0, 6.0/5.0, 5.0/4.0, 4.0/3.0,
-				45.0/32.0, 3.0/2.0, 8.0/5.0, 5.0/3.0, 9.0/5.0, 15.0/8.0
-			};
+			for (size_t note = 0; note < uiFrequencies.size(); ++note)
+				snapshot.frequencies[note] = uiFrequencies[note].load(std::memory_order_relaxed);
 			
-			double ratio = justRatios[intervalWithinOctave] * std::pow(2.0, octaves);
-			rootFreq = accumulatedDriftFrequency * ratio;
-		}
-		else if (currentMeasure == 0) {
-			rootFreq = CONCERT_A_FREQ * std::pow(2.0, (currentRoot - 69) / 12.0);
-		}
-		else {
-			// Calculate iteratively from measure 0
-			double iterFreq;
-			if (hasAccumulatedDrift) {
-				int lastMeasureRoot = measureRoots[sequenceLength - 1];
-				int firstRoot = measureRoots[0];
-				int semitoneDistance = firstRoot - lastMeasureRoot;
-				int octaves = semitoneDistance / 12;
-				int intervalWithinOctave = semitoneDistance % 12;
-				if (intervalWithinOctave < 0) {
-					intervalWithinOctave += 12;
-					octaves -= 1;
-				}
-				
-				static const std::array<double, 12> justRatios = {
-					1.0, 16.0/15.0, 9.0/8.0, 6.0/5.0, 5.0/4.0, 4.0/3.0,
-					45.0/32.0, 3.0/2.0, 8.0/5.0, 5.0/3.0, 9.0/5.0, 15.0/8.0
-				};
-				
-				double ratio = justRatios[intervalWithinOctave] * std::pow(2.0, octaves);
-				iterFreq = accumulatedDriftFrequency * ratio;
-			}
-			else {
-				iterFreq = CONCERT_A_FREQ * std::pow(2.0, (measureRoots[0] - 69) / 12.0);
-			}
+			std::atomic_thread_fence(std::memory_order_acquire);
 			
-			for (int m = 1; m <= currentMeasure; ++m) {
-				int prevRoot = measureRoots[m - 1];
-				int thisRoot = measureRoots[m];
-				int semitoneDistance = thisRoot - prevRoot;
-				int octaves = semitoneDistance / 12;
-				int intervalWithinOctave = semitoneDistance % 12;
-				if (intervalWithinOctave < 0) {
-					intervalWithinOctave += 12;
-					octaves -= 1;
-				}
-				
-				static const std::array<double, 12> justRatios = {
-					1.0, 16.0/15.0, 9.0/8.0, 6.0/5.0, 5.0/4.0, 4.0/3.0,
-					45.0/32.0, 3.0/2.0, 8.0/5.0, 5.0/3.0, 9.0/5.0, 15.0/8.0
-				};
-				
-				double ratio = justRatios[intervalWithinOctave] * std::pow(2.0, octaves);
-				iterFreq = iterFreq * ratio;
-			}
-			rootFreq = iterFreq;
+			if (uiSnapshotSequence.load(std::memory_order_relaxed) == sequence)
+				return snapshot;
 		}
+		
+		juce::Thread::yield();
 	}
-	
-	// Now calculate the frequency of midiNote relative to currentRoot
-	int semitoneDistance = midiNote - currentRoot;
-	int octaves = semitoneDistance / 12;
-	int intervalWithinOctave = semitoneDistance % 12;
-	if (intervalWithinOctave < 0) {
-		intervalWithinOctave += 12;
-		octaves -= 1;
-	}
-	
-	static const std::array<double, 12> justRatios = {
-		1.0, 16.0/15.0, 9.0/8.0, 6.0/5.0, 5.0/4.0, 4.0/3.0,
-		45.0/32.0, 3.0/2.0, 8.0/5.0, 5.0/3.0, 9.0/5.0, 15.0/8.0
-	};
-	
-	double ratio = justRatios[intervalWithinOctave] * std::pow(2.0, octaves);
-	return rootFreq * ratio;
+}
+
+int FluidJustIntonationProcessor::getCurrentMeasure() const
+{
+	return uiMeasure.load();
+}
+
+double FluidJustIntonationProcessor::getFrequencyForNote(int midiNote) const
+{
+	return uiFrequencies[static_cast<size_t>(juce::jlimit(0, 127, midiNote))].load();
 }
 
 //==============================================================================
@@ -735,6 +909,21 @@ bool FluidJustIntonationProcessor::isSoundFontLoaded() const
 	return synth.isSoundFontLoaded();
 }
 
+bool FluidJustIntonationProcessor::isLoadingSoundFontSamples() const
+{
+	return synth.isLoadingSoundFontSamples();
+}
+
+bool FluidJustIntonationProcessor::isSoundFontStreaming() const
+{
+	return synth.isSoundFontStreaming();
+}
+
+int FluidJustIntonationProcessor::getSoundFontStreamUnderruns() const
+{
+	return synth.getSoundFontStreamUnderruns();
+}
+
 juce::String FluidJustIntonationProcessor::getSoundFontName() const
 {
 	return synth.getSoundFontName();
@@ -765,6 +954,31 @@ int FluidJustIntonationProcessor::getCurrentPreset() const
 	return synth.getCurrentPreset();
 }
 
+int FluidJustIntonationProcessor::getChannelPreset(int midiChannel) const
+{
+	return synth.getChannelPreset(midiChannel);
+}
+
+bool FluidJustIntonationProcessor::isPresetLoaded(int presetIndex) const
+{
+	return synth.isPresetLoaded(presetIndex);
+}
+
+void FluidJustIntonationProcessor::setWavetable(std::unique_ptr<Wavetable> newWavetable)
+{
+	synth.setWavetable(std::move(newWavetable));
+}
+
+juce::String FluidJustIntonationProcessor::getWavetableName() const
+{
+	return synth.getWavetableName();
+}
+
+juce::File FluidJustIntonationProcessor::getWavetableFile() const
+{
+	return synth.getWavetableFile();
+}
+
 void FluidJustIntonationProcessor::setSynthMode(FluidJustIntonationSynth::SynthMode mode)
 {
 	synth.setSynthMode(mode);
@@ -3,7 +3,10 @@
 #include <JuceHeader.h>
 #include <vector>
 #include <array>
+#include <atomic>
 #include "Synthesizer.h"
+#include "MtsOutput.h"
+#include "MpeOutput.h"
 #include "JucePluginDefines.h"
 
 //==============================================================================
@@ -11,7 +14,8 @@
  * FluidJustIntonationProcessor - Main audio processor for the Fluid Just Intonation VST
  */
 class FluidJustIntonationProcessor  : public juce::AudioProcessor,
-									 public juce::AudioProcessorValueTreeState::Listener
+									 public juce::AudioProcessorValueTreeState::Listener,
+									 private juce::Timer
 {
 public:
 	//==============================================================================
@@ -53,7 +57,8 @@ public:
 	void setStateInformation (const void* data, int sizeInBytes) override;
 
 	//==============================================================================
-	// Called when a parameter changes
+	// Called when a parameter changes, on whichever thread the host uses. The change is
+	// only recorded here and takes effect at the start of the next processBlock.
 	void parameterChanged(const juce::String& parameterID, float newValue) override;
 
 	//==============================================================================
@@ -63,6 +68,9 @@ public:
 		Shift   // Each new scale is based on the previous scale
 	};
 
+	// The setters below are safe from any thread, they record the change for the audio
+	// thread and the getters return the latest value asked for.
+
 	// Set number of measures in sequence (4, 8, or 16)
 	void setSequenceLength(int length);
 	int getSequenceLength() const;
@@ -70,35 +78,59 @@ public:
 	// Set the mode (Set or Shift)
 	void setIntonationMode(IntonationMode mode);
 	IntonationMode getIntonationMode() const;
+	
+	// How the tuning is sent to the MIDI output, alongside the notes passed through
+	enum class TuningOutput {
+		Off,
+		MtsSysEx,   // Real-time single note tuning changes for the notes that change
+		Mpe         // Each note on its own channel, bent to its tuning
+	};
 
 	// Set root note for a specific measure in the sequence
 	void setMeasureRoot(int measureIndex, int rootNote);
 	int getMeasureRoot(int measureIndex) const;
 	
-	int getCurrentMeasure() const 
+	// The tuning as the audio thread last used it, published at the end of each block
+	// so the editor never reads the measure or the drift while they change
+	struct TuningSnapshot
 	{
-		return currentMeasure;
-	}
-	
-	// Reset accumulated drift (for Shift mode)
-	void resetAccumulatedDrift();
+		int measure = 0;
+		int root = 60;
+		std::array<double, 128> frequencies {};
+	};
 	
-	// Get the frequency for a specific MIDI note based on current tuning
+	// Safe from any thread. Take one snapshot to draw from, so every note shown comes
+	// from the same block.
+	TuningSnapshot getTuningSnapshot() const;
+	int getCurrentMeasure() const;
 	double getFrequencyForNote(int midiNote) const;
+	
+	// Reset accumulated drift (for Shift mode), on the audio thread
+	void resetAccumulatedDrift();
 
 	//==============================================================================
 	// SoundFont support
 	bool loadSoundFont(const juce::File& file);
 	void unloadSoundFont();
 	bool isSoundFontLoaded() const;
+	bool isLoadingSoundFontSamples() const;   // Presets are listed while the samples still load in the background
 	juce::String getSoundFontName() const;
 	juce::File getSoundFontFile() const;
+	bool isSoundFontStreaming() const;          // Set by the "diskStreaming" parameter or for very large files
+	int getSoundFontStreamUnderruns() const;
 
 	// Preset management
 	int getPresetCount() const;
 	juce::String getPresetName(int presetIndex) const;
 	void setPreset(int presetIndex);
 	int getCurrentPreset() const;
+	int getChannelPreset(int midiChannel) const;
+	bool isPresetLoaded(int presetIndex) const;
+
+	// Wavetable support
+	void setWavetable(std::unique_ptr<Wavetable> newWavetable);
+	juce::String getWavetableName() const;
+	juce::File getWavetableFile() const;   // Empty for the built-in waveforms
 
 	// Synthesis mode
 	void setSynthMode(FluidJustIntonationSynth::SynthMode mode);
@@ -116,6 +148,7 @@ private:
 	// Constants
 	static constexpr double CONCERT_A_FREQ = 440.0;  // A4 reference frequency
 	static constexpr int MAX_SEQUENCE_LENGTH = 16;   // Maximum sequence length
+	static constexpr double RELEASE_TAIL_SECONDS = 2.0; // Tail reported to the host after the last note
 	
 	// Just Intonation frequency calculation
 	double getJustFrequency(int midiNote, int rootNote, bool useCurrentRootAsReference = false);
@@ -132,17 +165,39 @@ private:
 	// Get the root frequency for a specific measure (used for recursion in SHIFT mode)
 	double getCurrentMeasureRootFrequencyForMeasure(int measureIndex);
 	
-	// Current state
+	// Current state, owned by the audio thread
 	int sequenceLength = 4;                 // Default to 4 measures
 	IntonationMode intonationMode = IntonationMode::Set;
 	std::array<int, MAX_SEQUENCE_LENGTH> measureRoots;  // Root note for each measure (MIDI note numbers)
 	
+	// Changes requested from other threads, applied together at the start of a block
+	std::atomic<int> pendingSequenceLength { 4 };
+	std::atomic<IntonationMode> pendingIntonationMode { IntonationMode::Set };
+	std::array<std::atomic<int>, MAX_SEQUENCE_LENGTH> pendingMeasureRoots;
+	std::atomic<int> pendingPolyphony { 16 };
+	std::atomic<float> pendingRetuneGlideMs { 0.0f };
+	std::atomic<int> pendingControlBlockSize { 0 };
+	std::atomic<TuningOutput> pendingTuningOutput { TuningOutput::Off };
+	std::atomic<bool> parametersChanged { false };
+	
+	// SoundFont voice count, which reallocates and so is applied by the timer on the message thread
+	std::atomic<int> pendingSoundFontPolyphony { SoundFontPlayer::DEFAULT_POLYPHONY };
+	void timerCallback() override;
+	
+	// Set when the tuning needs recompiling, because a parameter, the measure or the drift changed
+	bool frequencyMapDirty = true;
+	
+	// Copies the pending values into the current state, on the audio thread
+	void applyPendingParameters();
+	
 	// Current playback state
 	int currentMeasure = 0;
 	int previousMeasure = -1;
 	double ppqPosition = 0.0;
 	double bpm = 120.0;
 	bool wasPlaying = false;  // Track playback state to detect stop
+	double samplesToNextBar = -1.0;  // From the start of the block, negative when stopped
+	int nextBarMeasure = 0;
 	
 	// Accumulated drift for Shift mode looping
 	double accumulatedDriftFrequency = 0.0;
@@ -151,6 +206,9 @@ private:
 	// Update the current measure based on the playback position
 	void updateCurrentMeasure(juce::AudioPlayHead* playHead);
 	
+	// Makes newMeasure current, carrying the drift over when Shift mode loops
+	void moveToMeasure(int newMeasure);
+	
 	// Map from MIDI note number to frequency based on current tuning
 	double midiNoteToFrequency(int midiNote);
 	
@@ -167,8 +225,32 @@ private:
 	// Synthesizer for audio output
 	FluidJustIntonationSynth synth;
 	
-	// Map from MIDI note to frequency for the synth
-	std::map<int, double> currentFrequencyMap;
+	// Frequency of every MIDI note for the synth. A fixed array, so copying it on the
+	// audio thread never allocates.
+	std::array<double, 128> currentFrequencyMap {};
+	
+	// The editor's copy of the tuning, written only by publishUiSnapshot. The sequence
+	// count is odd while a copy is being written, so readers retry instead of mixing two.
+	std::atomic<uint32_t> uiSnapshotSequence { 0 };
+	std::atomic<int> uiMeasure { 0 };
+	std::atomic<int> uiRoot { 60 };
+	std::array<std::atomic<double>, 128> uiFrequencies;
+	bool uiSnapshotDirty = true;
+	
+	// Copies the tuning for the editor if it changed, at the end of each block
+	void publishUiSnapshot();
+	
+	// Tuning sent to the MIDI output, merged ahead of the notes at the end of each block.
+	// In MPE mode the rewritten notes go here too and replace the input.
+	TuningOutput tuningOutput = TuningOutput::Off;
+	MtsOutput mtsOutput;
+	MpeOutput mpeOutput;
+	juce::MidiBuffer tuningMessages;
+	juce::MidiBuffer mergedMidi;
+	
+	// Renders part of the block and, in MPE mode, rewrites the notes it holds to the output
+	void renderRange(juce::AudioBuffer<float>& buffer, const juce::MidiBuffer& midiMessages,
+					 int startSample, int numSamples, bool idle);
 
 	// SoundFont file path for state saving
 	juce::String soundFontPath;
@@ -176,5 +258,5 @@ private:
 
 	//==============================================================================
 	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FluidJustIntonationProcessor)
-	void updateFrequencyMap();
+	void updateFrequencyMap(int samplePosition = 0);
 };
\ No newline at end of file
@@ -1,15 +1,122 @@
+#include "SoundFontPlayer.h"
+#include "AudioThreadAllocations.h"
+
+#if JUCE_DEBUG
+// Debug builds route tinysoundfont's heap use through these to catch allocations on the audio thread
+namespace
+{
+	void* tsfCheckedMalloc(size_t size)               { checkAllocationAllowed(); return std::malloc(size); }
+	void* tsfCheckedRealloc(void* ptr, size_t size)   { checkAllocationAllowed(); return std::realloc(ptr, size); }
+	void tsfCheckedFree(void* ptr)                    { if (ptr != nullptr) checkAllocationAllowed(); std::free(ptr); }
+}
+#define TSF_MALLOC  tsfCheckedMalloc
+#define TSF_REALLOC tsfCheckedRealloc
+#define TSF_FREE    tsfCheckedFree
+#endif
+
 // Define this before including tinysoundfont to get the implementation
 #define TSF_IMPLEMENTATION
-#include "SoundFontPlayer.h"
 #include "tsf.h"  // tinysoundfont header - download from https://github.com/schellingb/TinySoundFont
 
+namespace
+{
+	tsf_stream makeTsfStream(juce::FileInputStream& input)
+	{
+		return {
+			&input,
+			[](void* data, void* ptr, unsigned int size)
+			{
+				return static_cast<juce::FileInputStream*>(data)->read(ptr, static_cast<int>(size));
+			},
+			[](void* data, unsigned int count)
+			{
+				auto* input = static_cast<juce::FileInputStream*>(data);
+				return input->setPosition(input->getPosition() + count) ? 1 : 0;
+			}
+		};
+	}
+	
+	// SF3 stores each sample as a mono Ogg Vorbis stream
+	std::unique_ptr<juce::AudioFormatReader> createOggReader(const void* compressed, unsigned int size)
+	{
+		juce::OggVorbisAudioFormat format;
+		return std::unique_ptr<juce::AudioFormatReader>(
+			format.createReaderFor(new juce::MemoryInputStream(compressed, size, false), true));
+	}
+	
+	unsigned int getOggSampleLength(void*, const void* compressed, unsigned int size)
+	{
+		// The granule position of the last page is the length of a mono stream, which saves
+		// setting up a decoder for every sample while the presets are loaded
+		const auto* bytes = static_cast<const juce::uint8*>(compressed);
+		
+		for (int page = static_cast<int>(size) - 27; page >= 0; --page)
+		{
+			if (bytes[page] != 'O' || bytes[page + 1] != 'g' || bytes[page + 2] != 'g' || bytes[page + 3] != 'S' || bytes[page + 4] != 0)
+				continue;
+			
+			const auto granule = static_cast<juce::int64>(juce::ByteOrder::littleEndianInt64(bytes + page + 6));
+			
+			if (granule > 0 && granule <= std::numeric_limits<int>::max())
+				return static_cast<unsigned int>(granule);
+			
+			if (granule != -1)
+				break;
+		}
+		
+		auto reader = createOggReader(compressed, size);
+		
+		if (reader == nullptr || reader->lengthInSamples <= 0 || reader->lengthInSamples > std::numeric_limits<int>::max())
+			return 0;
+		
+		return static_cast<unsigned int>(reader->lengthInSamples);
+	}
+	
+	int decodeOggSamples(void* data, tsf_decode_job* jobs, int count)
+	{
+		// Largest samples first so the last jobs left running are short ones
+		std::vector<tsf_decode_job*> order;
+		order.reserve(static_cast<size_t>(count));
+		for (int i = 0; i < count; ++i)
+			order.push_back(jobs + i);
+		std::sort(order.begin(), order.end(), [](const tsf_decode_job* a, const tsf_decode_job* b) { return a->size > b->size; });
+		
+		std::atomic<int> remaining { count };
+		std::atomic<bool> failed { false };
+		juce::WaitableEvent finished;
+		auto* pool = static_cast<juce::ThreadPool*>(data);
+		
+		for (auto* job : order)
+		{
+			pool->addJob([job, &remaining, &failed, &finished]
+			{
+				auto reader = createOggReader(job->compressed, job->size);
+				float* channels[] = { job->out };
+				
+				if (reader == nullptr || !reader->read(channels, 1, 0, static_cast<int>(job->length)))
+					failed = true;
+				
+				if (--remaining == 0)
+					finished.signal();
+			});
+		}
+		
+		finished.wait();
+		return failed ? 0 : 1;
+	}
+}
+
 //==============================================================================
 SoundFontPlayer::SoundFontPlayer()
 {
+	interleavedBuffer.resize(static_cast<size_t>(blockSize) * 2);
 }
 
 SoundFontPlayer::~SoundFontPlayer()
 {
+	cacheWriteCancelled = true;
+	backgroundThread.removeTimeSliceClient(this);
+	backgroundThread.stopThread(1000);
 	unloadSoundFont();
 }
 
@@ -20,10 +127,12 @@ void SoundFontPlayer::prepareToPlay(double newSampleRate, int newBlockSize)
 	
 	sampleRate = newSampleRate;
 	blockSize = newBlockSize;
+	interleavedBuffer.resize(static_cast<size_t>(juce::jmax(1, blockSize)) * 2);
 	
 	if (soundFont != nullptr)
 	{
 		tsf_set_output(soundFont, TSF_STEREO_INTERLEAVED, static_cast<int>(sampleRate), globalGain);
+		applyControlBlockSize();
 	}
 }
 
@@ -36,8 +145,6 @@ void SoundFontPlayer::releaseResources()
 //==============================================================================
 bool SoundFontPlayer::loadSoundFont(const juce::File& file)
 {
-	juce::ScopedLock sl(lock);
-	
 	// Unload any existing soundfont
 	unloadSoundFont();
 	
@@ -47,26 +154,63 @@ bool SoundFontPlayer::loadSoundFont(const juce::File& file)
 		return false;
 	}
 	
-	// Load the soundfont
-	soundFont = tsf_load_filename(file.getFullPathName().toRawUTF8());
-	
-	if (soundFont == nullptr)
 	{
-		DBG("SoundFontPlayer: Failed to load soundfont: " + file.getFullPathName());
-		return false;
+		// The file is parsed without the audio lock, which is only taken to swap the new
+		// instance in, so the audio thread keeps running meanwhile
+		juce::ScopedLock ssl(streamLock);
+		tsf* loaded = nullptr;
+		
+		// Stream big banks from disk, falling back to loading everything if the file can't be streamed (SF3)
+		if (diskStreamingEnabled || file.getSize() > STREAMING_SIZE_THRESHOLD)
+			loaded = loadWithSampleReader(file, true);
+		
+		const auto cacheFile = getCacheFile(file);
+		
+		if (loaded == nullptr && bankCacheEnabled)
+			loaded = loadCached(cacheFile);
+		
+		// Load the presets now and the samples in the background, caching the result for next time.
+		// Compressed (SF3) samples are decoded in the background too, and the cache saves decoding them again.
+		if (loaded == nullptr)
+		{
+			loaded = loadWithSampleReader(file, false);
+			
+			if (loaded == nullptr)
+				loaded = loadDecoded(file);
+			
+			if (loaded != nullptr && bankCacheEnabled)
+				pendingCacheFile = cacheFile;
+		}
+		
+		if (loaded == nullptr)
+		{
+			DBG("SoundFontPlayer: Failed to load soundfont: " + file.getFullPathName());
+			return false;
+		}
+		
+		juce::ScopedLock sl(lock);
+		soundFont = loaded;
+		
+		// Configure the soundfont
+		tsf_set_output(soundFont, TSF_STEREO_INTERLEAVED, static_cast<int>(sampleRate), globalGain);
+		tsf_set_max_voices(soundFont, maxPolyphony);
+		tsf_set_max_channels(soundFont, NUM_TSF_CHANNELS);
+		applyControlBlockSize();
+		
+		// Store file info
+		soundFontFile = file;
+		soundFontName = file.getFileNameWithoutExtension();
+		
+		// Select the first preset by default
+		currentPreset = 0;
+		currentBank = 0;
+		resetChannelPresets();
+		
+		mipmapsPending = sampleMipmapsEnabled.load();
 	}
 	
-	// Configure the soundfont
-	tsf_set_output(soundFont, TSF_STEREO_INTERLEAVED, static_cast<int>(sampleRate), globalGain);
-	tsf_set_max_voices(soundFont, maxPolyphony);
-	
-	// Store file info
-	soundFontFile = file;
-	soundFontName = file.getFileNameWithoutExtension();
-	
-	// Select the first preset by default
-	currentPreset = 0;
-	currentBank = 0;
+	// Streams, the rest of a two-phase load, the cache and mipmaps are handled in the background
+	startBackgroundWork();
 	
 	DBG("SoundFontPlayer: Loaded soundfont: " + soundFontName + " with " + 
 		juce::String(getPresetCount()) + " presets");
@@ -76,48 +220,73 @@ bool SoundFontPlayer::loadSoundFont(const juce::File& file)
 
 bool SoundFontPlayer::loadSoundFont(const void* data, int sizeInBytes)
 {
-	juce::ScopedLock sl(lock);
-	
 	// Unload any existing soundfont
 	unloadSoundFont();
 	
-	// Load from memory
-	soundFont = tsf_load_memory(data, sizeInBytes);
-	
-	if (soundFont == nullptr)
 	{
-		DBG("SoundFontPlayer: Failed to load soundfont from memory");
-		return false;
+		// Load from memory, outside the audio lock like a file
+		juce::ScopedLock ssl(streamLock);
+		tsf* loaded = tsf_load_memory(data, sizeInBytes);
+		
+		if (loaded == nullptr)
+		{
+			DBG("SoundFontPlayer: Failed to load soundfont from memory");
+			return false;
+		}
+		
+		juce::ScopedLock sl(lock);
+		soundFont = loaded;
+		
+		// Configure the soundfont
+		tsf_set_output(soundFont, TSF_STEREO_INTERLEAVED, static_cast<int>(sampleRate), globalGain);
+		tsf_set_max_voices(soundFont, maxPolyphony);
+		tsf_set_max_channels(soundFont, NUM_TSF_CHANNELS);
+		applyControlBlockSize();
+		
+		soundFontName = "Memory SoundFont";
+		soundFontFile = juce::File();
+		
+		// Select the first preset by default
+		currentPreset = 0;
+		currentBank = 0;
+		resetChannelPresets();
+		
+		mipmapsPending = sampleMipmapsEnabled.load();
 	}
 	
-	// Configure the soundfont
-	tsf_set_output(soundFont, TSF_STEREO_INTERLEAVED, static_cast<int>(sampleRate), globalGain);
-	tsf_set_max_voices(soundFont, maxPolyphony);
-	
-	soundFontName = "Memory SoundFont";
-	soundFontFile = juce::File();
-	
-	// Select the first preset by default
-	currentPreset = 0;
-	currentBank = 0;
-	
+	startBackgroundWork();
 	return true;
 }
 
 void SoundFontPlayer::unloadSoundFont()
 {
-	juce::ScopedLock sl(lock);
+	juce::ScopedLock ssl(streamLock);
+	tsf* closing = nullptr;
 	
-	if (soundFont != nullptr)
 	{
-		allNotesOff();
-		tsf_close(soundFont);
+		// The audio thread only has to wait for the instance to be detached
+		juce::ScopedLock sl(lock);
+		closing = soundFont;
 		soundFont = nullptr;
+		
+		soundFontName.clear();
+		soundFontFile = juce::File();
+		noteChannels.fill(NoteChannel());
+		channelStates.fill(ChannelState());
+		controllersDirty = false;
 	}
 	
-	soundFontName.clear();
-	soundFontFile = juce::File();
-	activeNotes.clear();
+	// A cache write in progress works on its own copy without holding streamLock. It stops
+	// at its next chunk instead of being waited for.
+	cacheWriteCancelled = true;
+	
+	tsf_close(closing);
+	streamFile.reset();
+	streaming = false;
+	deferredSampleFile.reset();
+	samplesLoading = false;
+	cacheMapping.reset();
+	pendingCacheFile = juce::File();
 }
 
 //==============================================================================
@@ -138,6 +307,12 @@ juce::String SoundFontPlayer::getPresetName(int presetIndex) const
 	return name ? juce::String(name) : juce::String("Preset " + juce::String(presetIndex));
 }
 
+bool SoundFontPlayer::isPresetLoaded(int presetIndex) const
+{
+	juce::ScopedLock sl(lock);
+	return soundFont != nullptr && tsf_preset_is_loaded(soundFont, presetIndex);
+}
+
 void SoundFontPlayer::setPreset(int presetIndex)
 {
 	juce::ScopedLock sl(lock);
@@ -145,11 +320,49 @@ void SoundFontPlayer::setPreset(int presetIndex)
 	if (presetIndex >= 0 && presetIndex < getPresetCount())
 	{
 		currentPreset = presetIndex;
+		
+		// Channel 10 keeps its drum kit
+		const bool hasDrumKit = tsf_get_presetindex(soundFont, PERCUSSION_BANK, 0) >= 0;
+		for (int channel = 0; channel < NUM_MIDI_CHANNELS; ++channel)
+			if (channel != DRUM_CHANNEL || !hasDrumKit)
+				setChannelPreset(channel, presetIndex);
+		
 		DBG("SoundFontPlayer: Selected preset " + juce::String(presetIndex) + 
 			": " + getPresetName(presetIndex));
 	}
 }
 
+int SoundFontPlayer::getChannelPreset(int midiChannel) const
+{
+	juce::ScopedLock sl(lock);
+	
+	if (!juce::isPositiveAndBelow(midiChannel, NUM_MIDI_CHANNELS))
+		return 0;
+	
+	return channelStates[midiChannel].presetIndex;
+}
+
+void SoundFontPlayer::setChannelPreset(int midiChannel, int presetIndex)
+{
+	auto& state = channelStates[midiChannel];
+	state.presetIndex = presetIndex;
+	state.percussion = tsf_get_presetbank(soundFont, presetIndex) >= PERCUSSION_BANK;
+	
+	// Program changes resolve against the MIDI channel in tsf, keep it on the same preset
+	tsf_channel_set_presetindex(soundFont, midiChannel, presetIndex);
+}
+
+void SoundFontPlayer::resetChannelPresets()
+{
+	if (soundFont == nullptr)
+		return;
+	
+	const int drumKit = tsf_get_presetindex(soundFont, PERCUSSION_BANK, 0);
+	
+	for (int channel = 0; channel < NUM_MIDI_CHANNELS; ++channel)
+		setChannelPreset(channel, channel == DRUM_CHANNEL && drumKit >= 0 ? drumKit : currentPreset);
+}
+
 void SoundFontPlayer::setBank(int bank)
 {
 	juce::ScopedLock sl(lock);
@@ -161,35 +374,55 @@ void SoundFontPlayer::noteOn(int midiChannel, int midiNote, float velocity)
 {
 	juce::ScopedLock sl(lock);
 	
-	if (soundFont == nullptr)
+	if (soundFont == nullptr || !juce::isPositiveAndBelow(midiChannel, NUM_MIDI_CHANNELS)
+		|| !juce::isPositiveAndBelow(midiNote, 128))
 		return;
 	
-	// Calculate the target frequency (use custom tuning if available)
+	// A retriggered key ends its previous note, so each key owns at most one note channel
+	if (findNoteChannel(midiChannel, midiNote) >= 0)
+		noteOff(midiChannel, midiNote);
+	
+	const auto& state = channelStates[midiChannel];
+	
+	// Calculate the target frequency (use custom tuning if available, drums stay at their pitch)
 	double targetFreq = getMidiNoteFrequency(midiNote);
-	auto it = noteFrequencyMap.find(midiNote);
-	if (it != noteFrequencyMap.end())
+	const double customFreq = noteFrequencyMap[static_cast<size_t>(midiNote)];
+	if (customFreq > 0.0 && !state.percussion)
 	{
-		targetFreq = it->second;
+		targetFreq = customFreq;
 	}
 	
-	// Calculate pitch bend needed for this frequency
-	float pitchBend = calculatePitchBendForFrequency(midiNote, targetFreq);
+	const int index = allocateNoteChannel();
+	auto& channel = noteChannels[static_cast<size_t>(index)];
+	const int tsfChannel = tsfChannelOf(index);
+	
+	// Every note channel sounding: the oldest note makes way
+	if (isSounding(channel))
+		tsf_channel_sounds_off_all(soundFont, tsfChannel);
 	
-	// Apply pitch wheel (tinysoundfont uses -1 to 1 range for pitch bend)
-	// We need to set this per-channel, but for simplicity we'll use channel 0
-	tsf_channel_set_pitchwheel(soundFont, midiChannel, static_cast<int>((pitchBend + 1.0f) * 8192.0f));
+	channel.midiChannel = midiChannel;
+	channel.midiNote = midiNote;
+	channel.keyDown = true;
+	channel.sustained = false;
+	channel.percussion = state.percussion;
+	channel.targetFrequency = targetFreq;
+	channel.tuningOffset = calculateTuningOffset(midiNote, targetFreq);
+	channel.lastUsed = ++noteEventCounter;
 	
-	// Start the note using preset selection
-	tsf_channel_set_presetindex(soundFont, midiChannel, currentPreset);
-	tsf_channel_note_on(soundFont, midiChannel, midiNote, velocity);
+	// The note channel takes on the MIDI channel's preset, tuning and controllers, then is
+	// bent to this note's frequency (on top of the incoming pitch wheel). Like the preset,
+	// the tsf setters return early for values that didn't change since the channel's last note.
+	if (channel.presetIndex != state.presetIndex)
+	{
+		tsf_channel_set_presetindex(soundFont, tsfChannel, state.presetIndex);
+		channel.presetIndex = state.presetIndex;
+	}
 	
-	// Track the active note
-	ActiveNote note;
-	note.midiChannel = midiChannel;
-	note.midiNote = midiNote;
-	note.targetFrequency = targetFreq;
-	note.needsRetune = false;
-	activeNotes.push_back(note);
+	tsf_channel_set_tuning(soundFont, tsfChannel, tsf_channel_get_tuning(soundFont, midiChannel));
+	tsf_channel_set_sustain(soundFont, tsfChannel, state.sustain ? 1 : 0);
+	applyControllers(index, true, true, true, true);
+	
+	tsf_channel_note_on(soundFont, tsfChannel, midiNote, velocity);
 }
 
 void SoundFontPlayer::noteOff(int midiChannel, int midiNote)
@@ -199,16 +432,51 @@ void SoundFontPlayer::noteOff(int midiChannel, int midiNote)
 	if (soundFont == nullptr)
 		return;
 	
-	tsf_channel_note_off(soundFont, midiChannel, midiNote);
+	const int index = findNoteChannel(midiChannel, midiNote);
+	if (index < 0)
+		return;
 	
-	// Remove from active notes
-	activeNotes.erase(
-		std::remove_if(activeNotes.begin(), activeNotes.end(),
-			[midiChannel, midiNote](const ActiveNote& note) {
-				return note.midiChannel == midiChannel && note.midiNote == midiNote;
-			}),
-		activeNotes.end()
-	);
+	auto& channel = noteChannels[static_cast<size_t>(index)];
+	tsf_channel_note_off(soundFont, tsfChannelOf(index), midiNote);
+	
+	channel.keyDown = false;
+	channel.sustained = channelStates[midiChannel].sustain;
+	channel.lastUsed = ++noteEventCounter;
+}
+
+int SoundFontPlayer::allocateNoteChannel() const
+{
+	int bestFree = -1;
+	int oldestSounding = 0;
+	
+	for (int index = 0; index < NUM_NOTE_CHANNELS; ++index)
+	{
+		const auto& channel = noteChannels[static_cast<size_t>(index)];
+		
+		if (!isSounding(channel))
+		{
+			if (bestFree < 0 || channel.lastUsed < noteChannels[static_cast<size_t>(bestFree)].lastUsed)
+				bestFree = index;
+		}
+		else if (channel.lastUsed < noteChannels[static_cast<size_t>(oldestSounding)].lastUsed)
+		{
+			oldestSounding = index;
+		}
+	}
+	
+	return bestFree >= 0 ? bestFree : oldestSounding;
+}
+
+int SoundFontPlayer::findNoteChannel(int midiChannel, int midiNote) const
+{
+	for (int index = 0; index < NUM_NOTE_CHANNELS; ++index)
+	{
+		const auto& channel = noteChannels[static_cast<size_t>(index)];
+		if (channel.keyDown && channel.midiNote == midiNote && channel.midiChannel == midiChannel)
+			return index;
+	}
+	
+	return -1;
 }
 
 void SoundFontPlayer::allNotesOff()
@@ -220,47 +488,589 @@ void SoundFontPlayer::allNotesOff()
 		tsf_reset(soundFont);
 	}
 	
-	activeNotes.clear();
+	// tsf_reset drops all channel state, so start our controllers and presets from scratch too
+	noteChannels.fill(NoteChannel());
+	channelStates.fill(ChannelState());
+	controllersDirty = false;
+	resetChannelPresets();
 }
 
-//==============================================================================
-void SoundFontPlayer::setNoteFrequency(int midiNote, double frequencyHz)
+int SoundFontPlayer::getActiveVoiceCount() const
 {
 	juce::ScopedLock sl(lock);
-	noteFrequencyMap[midiNote] = frequencyHz;
+	
+	if (soundFont == nullptr)
+		return 0;
+	
+	return tsf_active_voice_count(soundFont);
 }
 
-void SoundFontPlayer::updateFrequencyMapping(const std::map<int, double>& midiNoteToFreqMap)
+//==============================================================================
+tsf* SoundFontPlayer::loadWithSampleReader(const juce::File& file, bool streamSamples)
 {
-	juce::ScopedLock sl(lock);
-	noteFrequencyMap = midiNoteToFreqMap;
+	// One sequential reader for the hydra and a second one kept open for the sample reads
+	juce::FileInputStream hydraInput(file);
+	auto sampleInput = std::make_unique<juce::FileInputStream>(file);
+	
+	if (hydraInput.failedToOpen() || sampleInput->failedToOpen())
+		return nullptr;
+	
+	tsf_stream hydraStream = makeTsfStream(hydraInput);
 	
-	// Mark all active notes for retuning
-	for (auto& note : activeNotes)
+	tsf_stream_source sampleSource {
+		sampleInput.get(),
+		[](void* data, void* ptr, unsigned int offset, unsigned int size)
+		{
+			auto* input = static_cast<juce::FileInputStream*>(data);
+			return input->setPosition(static_cast<juce::int64>(offset)) ? input->read(ptr, static_cast<int>(size)) : 0;
+		}
+	};
+	
+	if (streamSamples)
 	{
-		auto it = noteFrequencyMap.find(note.midiNote);
-		if (it != noteFrequencyMap.end())
+		tsf* streamed = tsf_load_streamed(&hydraStream, &sampleSource, STREAM_PRELOAD_SECONDS);
+		
+		if (streamed != nullptr)
 		{
-			if (std::abs(note.targetFrequency - it->second) > 0.01)
+			streamFile = std::move(sampleInput);
+			streaming = true;
+			DBG("SoundFontPlayer: Streaming samples from disk");
+		}
+		
+		return streamed;
+	}
+	
+	tsf* deferred = tsf_load_deferred(&hydraStream, &sampleSource);
+	
+	if (deferred != nullptr)
+	{
+		deferredSampleFile = std::move(sampleInput);
+		samplesLoading = true;
+	}
+	
+	return deferred;
+}
+
+tsf* SoundFontPlayer::loadDecoded(const juce::File& file)
+{
+	juce::FileInputStream input(file);
+	
+	if (input.failedToOpen())
+		return nullptr;
+	
+	if (decodePool == nullptr)
+		decodePool = std::make_unique<juce::ThreadPool>(juce::SystemStats::getNumCpus());
+	
+	tsf_stream stream = makeTsfStream(input);
+	tsf_sample_decoder decoder { decodePool.get(), getOggSampleLength, decodeOggSamples };
+	tsf* deferred = tsf_load_deferred_with_decoder(&stream, &decoder);
+	
+	if (deferred != nullptr)
+		samplesLoading = true;
+	
+	return deferred;
+}
+
+//==============================================================================
+juce::File SoundFontPlayer::getCacheFile(const juce::File& soundFontFile)
+{
+	// Keyed by path, size and modification time so an edited or replaced file gets a new entry
+	const juce::String key = soundFontFile.getFullPathName()
+						   + "|" + juce::String(soundFontFile.getSize())
+						   + "|" + juce::String(soundFontFile.getLastModificationTime().toMilliseconds());
+	
+	return juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+		.getChildFile("alchemicAV")
+		.getChildFile("Flooid")
+		.getChildFile("SoundFontCache")
+		.getChildFile(juce::String::toHexString(key.hashCode64()) + ".tsfcache");
+}
+
+tsf* SoundFontPlayer::loadCached(const juce::File& cacheFile)
+{
+	if (!cacheFile.existsAsFile())
+		return nullptr;
+	
+	auto mapping = std::make_unique<juce::MemoryMappedFile>(cacheFile, juce::MemoryMappedFile::readOnly);
+	
+	if (mapping->getData() == nullptr || mapping->getSize() > std::numeric_limits<unsigned int>::max())
+		return nullptr;
+	
+	tsf* cached = tsf_load_cache(mapping->getData(), static_cast<unsigned int>(mapping->getSize()));
+	
+	if (cached == nullptr)
+	{
+		// Damaged or written by another build, parse the file and cache it again
+		DBG("SoundFontPlayer: Discarding invalid cache " + cacheFile.getFullPathName());
+		mapping.reset();
+		cacheFile.deleteFile();
+		return nullptr;
+	}
+	
+	// Most recently used entries are the last to be evicted
+	cacheFile.setLastAccessTime(juce::Time::getCurrentTime());
+	
+	cacheMapping = std::move(mapping);
+	DBG("SoundFontPlayer: Loaded from cache " + cacheFile.getFullPathName());
+	return cached;
+}
+
+void SoundFontPlayer::writeCache(const tsf* snapshot, const juce::File& cacheFile)
+{
+	const juce::int64 cacheSize = tsf_cache_size(snapshot);
+	
+	if (cacheSize == 0 || cacheSize > BANK_CACHE_SIZE_LIMIT || !cacheFile.getParentDirectory().createDirectory())
+		return;
+	
+	trimCache(cacheFile.getParentDirectory(), cacheSize);
+	
+	// Write under a temporary name so a crash can't leave a truncated cache behind
+	const auto tempFile = cacheFile.withFileExtension("tmp");
+	bool written = false;
+	
+	{
+		tempFile.deleteFile();
+		juce::FileOutputStream output(tempFile);
+		
+		// The image goes straight to the file, section by section, checking for a cancel between writes
+		struct CacheOutput { juce::FileOutputStream& stream; const std::atomic<bool>& cancelled; };
+		CacheOutput target { output, cacheWriteCancelled };
+		
+		tsf_cache_writer writer {
+			&target,
+			[](void* data, const void* ptr, unsigned int size)
 			{
-				note.targetFrequency = it->second;
-				note.needsRetune = true;
+				auto* target = static_cast<CacheOutput*>(data);
+				return !target->cancelled && target->stream.write(ptr, size) ? 1 : 0;
 			}
+		};
+		
+		if (output.openedOk() && tsf_cache_write(snapshot, &writer))
+		{
+			output.flush();
+			written = output.getStatus().wasOk();
 		}
 	}
 	
-	// Apply retuning to active notes
-	if (soundFont != nullptr)
+	if (!written || !tempFile.moveFileTo(cacheFile))
+	{
+		tempFile.deleteFile();
+		DBG("SoundFontPlayer: Could not write cache " + cacheFile.getFullPathName());
+	}
+}
+
+void SoundFontPlayer::trimCache(const juce::File& cacheDirectory, juce::int64 spaceNeeded)
+{
+	// Evict the least recently used entries until the new one fits under the limit. Entries
+	// backing a loaded bank may refuse to be deleted on some systems and are skipped.
+	auto entries = cacheDirectory.findChildFiles(juce::File::findFiles, false, "*.tsfcache");
+	std::sort(entries.begin(), entries.end(),
+			  [](const juce::File& a, const juce::File& b) { return a.getLastAccessTime() < b.getLastAccessTime(); });
+	
+	juce::int64 totalSize = spaceNeeded;
+	for (const auto& entry : entries)
+		totalSize += entry.getSize();
+	
+	for (const auto& entry : entries)
 	{
-		for (auto& note : activeNotes)
+		if (totalSize <= BANK_CACHE_SIZE_LIMIT)
+			break;
+		
+		const juce::int64 entrySize = entry.getSize();
+		if (entry.deleteFile())
+			totalSize -= entrySize;
+	}
+}
+
+void SoundFontPlayer::setBankCacheEnabled(bool shouldCache)
+{
+	bankCacheEnabled = shouldCache;
+	
+	// A cache being written is abandoned as well
+	if (!shouldCache)
+		cacheWriteCancelled = true;
+}
+
+void SoundFontPlayer::setSampleMipmapsEnabled(bool shouldUseMipmaps)
+{
+	sampleMipmapsEnabled = shouldUseMipmaps;
+	
+	// The background thread runs while a bank is loaded and builds them for it. Tables
+	// that are already built stay in use until the next load.
+	if (shouldUseMipmaps)
+		mipmapsPending = true;
+}
+
+void SoundFontPlayer::startBackgroundWork()
+{
+	backgroundThread.addTimeSliceClient(this);
+	if (!backgroundThread.isThreadRunning())
+		backgroundThread.startThread();
+}
+
+int SoundFontPlayer::useTimeSlice()
+{
+	tsf* cacheSnapshot = nullptr;
+	juce::File cacheFile;
+	const int interval = serviceSoundFont(cacheSnapshot, cacheFile);
+	
+	if (cacheSnapshot == nullptr)
+		return interval;
+	
+	// Written with no lock held, so loading or unloading another bank meanwhile only cancels it
+	writeCache(cacheSnapshot, cacheFile);
+	
+	// The copy and the instance share a reference count that isn't atomic
+	juce::ScopedLock ssl(streamLock);
+	tsf_close(cacheSnapshot);
+	return 0;
+}
+
+int SoundFontPlayer::serviceSoundFont(tsf*& cacheSnapshot, juce::File& cacheFile)
+{
+	juce::ScopedLock ssl(streamLock);
+	
+	if (soundFont == nullptr)
+		return STREAM_IDLE_INTERVAL_MS;
+	
+	// Finish the sample phase of a two-phase load before caching or building mipmaps from the samples.
+	// Presets become playable as their samples arrive, without the audio lock.
+	if (samplesLoading)
+	{
+		const int result = tsf_load_deferred_step(soundFont, DEFERRED_LOAD_STEP_SAMPLES);
+		
+		if (result > 0)
+			return 0;
+		
+		if (result < 0)
 		{
-			if (note.needsRetune)
+			// Presets using the missing samples stay silent, and a partial bank mustn't be cached
+			DBG("SoundFontPlayer: Could not read or decode the sample data");
+			pendingCacheFile = juce::File();
+			mipmapsPending = false;
+		}
+		
+		deferredSampleFile.reset();
+		samplesLoading = false;
+	}
+	
+	if (mipmapsPending.exchange(false) && !tsf_build_mipmaps(soundFont, MIPMAP_LEVELS))
+		DBG("SoundFontPlayer: Not enough memory for sample mipmaps");
+	
+	if (pendingCacheFile != juce::File() && bankCacheEnabled)
+	{
+		// The cache is written from a copy sharing the instance's tables, which stay
+		// valid when the instance is closed before the write ends
+		cacheSnapshot = tsf_copy(soundFont);
+		cacheFile = pendingCacheFile;
+		cacheWriteCancelled = false;
+	}
+	
+	pendingCacheFile = juce::File();
+	
+	if (streamFile == nullptr)
+		return STREAM_IDLE_INTERVAL_MS;
+	
+	return tsf_stream_service(soundFont) > 0 ? STREAM_SERVICE_INTERVAL_MS : STREAM_IDLE_INTERVAL_MS;
+}
+
+int SoundFontPlayer::getStreamUnderrunCount() const
+{
+	juce::ScopedLock sl(lock);
+	
+	if (soundFont == nullptr)
+		return 0;
+	
+	return static_cast<int>(tsf_stream_get_underruns(soundFont));
+}
+
+//==============================================================================
+void SoundFontPlayer::programChange(int midiChannel, int programNumber)
+{
+	juce::ScopedLock sl(lock);
+	
+	if (soundFont == nullptr || !juce::isPositiveAndBelow(midiChannel, NUM_MIDI_CHANNELS))
+		return;
+	
+	// Resolve the program against the channel's bank select (channel 10 follows drum rules).
+	// Sounding voices keep their preset and only new notes pick up the change, so no reset is needed.
+	if (tsf_channel_set_presetnumber(soundFont, midiChannel, programNumber, midiChannel == DRUM_CHANNEL ? 1 : 0))
+		setChannelPreset(midiChannel, tsf_channel_get_preset_index(soundFont, midiChannel));
+}
+
+void SoundFontPlayer::pitchWheelMoved(int midiChannel, int pitchWheelValue)
+{
+	juce::ScopedLock sl(lock);
+	
+	if (!juce::isPositiveAndBelow(midiChannel, NUM_MIDI_CHANNELS))
+		return;
+	
+	channelStates[midiChannel].pitchWheel = pitchWheelValue;
+	channelStates[midiChannel].pitchDirty = true;
+	controllersDirty = true;
+}
+
+void SoundFontPlayer::channelPressureChanged(int midiChannel, int pressure)
+{
+	juce::ScopedLock sl(lock);
+	
+	if (!juce::isPositiveAndBelow(midiChannel, NUM_MIDI_CHANNELS))
+		return;
+	
+	channelStates[midiChannel].pressure = pressure;
+	channelStates[midiChannel].vibratoDirty = true;
+	controllersDirty = true;
+}
+
+void SoundFontPlayer::controllerMoved(int midiChannel, int controllerNumber, int controllerValue)
+{
+	juce::ScopedLock sl(lock);
+	
+	if (soundFont == nullptr || !juce::isPositiveAndBelow(midiChannel, NUM_MIDI_CHANNELS))
+		return;
+	
+	auto& state = channelStates[midiChannel];
+	
+	switch (controllerNumber)
+	{
+		// Continuous controllers are only recorded here and pushed to tsf by flushControllerChanges()
+		case 1:  state.modWheel   = (state.modWheel   & 0x7F)   | (controllerValue << 7); state.vibratoDirty = controllersDirty = true; return;
+		case 33: state.modWheel   = (state.modWheel   & 0x3F80) |  controllerValue;       state.vibratoDirty = controllersDirty = true; return;
+		case 7:  state.volume     = (state.volume     & 0x7F)   | (controllerValue << 7); state.volumeDirty = controllersDirty = true; return;
+		case 39: state.volume     = (state.volume     & 0x3F80) |  controllerValue;       state.volumeDirty = controllersDirty = true; return;
+		case 11: state.expression = (state.expression & 0x7F)   | (controllerValue << 7); state.volumeDirty = controllersDirty = true; return;
+		case 43: state.expression = (state.expression & 0x3F80) |  controllerValue;       state.volumeDirty = controllersDirty = true; return;
+		case 10: state.pan        = (state.pan        & 0x7F)   | (controllerValue << 7); state.panDirty = controllersDirty = true; return;
+		case 42: state.pan        = (state.pan        & 0x3F80) |  controllerValue;       state.panDirty = controllersDirty = true; return;
+		
+		case 64: // Sustain pedal
+			setSustain(midiChannel, controllerValue >= 64);
+			return;
+		
+		case 120: // All sound off
+		case 123: // All notes off
+			for (int index = 0; index < NUM_NOTE_CHANNELS; ++index)
 			{
-				float pitchBend = calculatePitchBendForFrequency(note.midiNote, note.targetFrequency);
-				tsf_channel_set_pitchwheel(soundFont, note.midiChannel, 
-					static_cast<int>((pitchBend + 1.0f) * 8192.0f));
-				note.needsRetune = false;
+				auto& channel = noteChannels[static_cast<size_t>(index)];
+				if (channel.midiChannel != midiChannel)
+					continue;
+				
+				if (controllerNumber == 120)
+					tsf_channel_sounds_off_all(soundFont, tsfChannelOf(index));
+				else if (isSounding(channel))
+					tsf_channel_note_off_all(soundFont, tsfChannelOf(index));
+				
+				if (isSounding(channel))
+					channel.lastUsed = ++noteEventCounter;
+				
+				channel.keyDown = channel.sustained = false;
 			}
+			return;
+		
+		case 121: // Reset all controllers
+			resetChannelControllers(midiChannel);
+			return;
+		
+		// Registered parameters: RPN 0 (pitch bend range) is ours, the rest is left to tsf
+		case 101: state.rpn = ((state.rpn < 0 ? 0 : state.rpn) & 0x7F)   | (controllerValue << 7); break;
+		case 100: state.rpn = ((state.rpn < 0 ? 0 : state.rpn) & 0x3F80) |  controllerValue;       break;
+		case 98:
+		case 99:  state.rpn = -1; break;
+		
+		case 6:
+		case 38:
+			if (state.rpn == 0)
+			{
+				if (controllerNumber == 6)
+					state.pitchBendRange = controllerValue + std::fmod(state.pitchBendRange, 1.0f);
+				else
+					state.pitchBendRange = std::floor(state.pitchBendRange) + controllerValue * 0.01f;
+				
+				state.pitchDirty = true;
+				controllersDirty = true;
+				return;
+			}
+			break;
+		
+		default:
+			break;
+	}
+	
+	// Everything we don't track (bank select, RPN selection, other RPNs) goes straight to tsf
+	tsf_channel_midi_control(soundFont, midiChannel, controllerNumber, controllerValue);
+	
+	// Fine and coarse tuning (RPN 1 and 2) land on the MIDI channel, pass them on to its notes
+	if (controllerNumber == 6 || controllerNumber == 38)
+	{
+		const float tuning = tsf_channel_get_tuning(soundFont, midiChannel);
+		
+		for (int index = 0; index < NUM_NOTE_CHANNELS; ++index)
+			if (noteChannels[static_cast<size_t>(index)].midiChannel == midiChannel)
+				tsf_channel_set_tuning(soundFont, tsfChannelOf(index), tuning);
+	}
+}
+
+void SoundFontPlayer::setSustain(int midiChannel, bool sustainOn)
+{
+	channelStates[midiChannel].sustain = sustainOn;
+	
+	for (int index = 0; index < NUM_NOTE_CHANNELS; ++index)
+	{
+		auto& channel = noteChannels[static_cast<size_t>(index)];
+		if (channel.midiChannel != midiChannel)
+			continue;
+		
+		tsf_channel_set_sustain(soundFont, tsfChannelOf(index), sustainOn ? 1 : 0);
+		
+		// Lifting the pedal ends the notes it held
+		if (!sustainOn && channel.sustained)
+		{
+			channel.sustained = false;
+			channel.lastUsed = ++noteEventCounter;
+		}
+	}
+}
+
+void SoundFontPlayer::resetChannelControllers(int midiChannel)
+{
+	auto& state = channelStates[midiChannel];
+	
+	// Volume, pan and the program survive a reset (MIDI recommended practice), the notes'
+	// tuning lives on their note channels
+	ChannelState resetState;
+	resetState.volume = state.volume;
+	resetState.pan = state.pan;
+	resetState.presetIndex = state.presetIndex;
+	resetState.percussion = state.percussion;
+	resetState.pitchDirty = resetState.volumeDirty = resetState.vibratoDirty = true;
+	state = resetState;
+	controllersDirty = true;
+	
+	setSustain(midiChannel, false);
+}
+
+void SoundFontPlayer::flushControllerChanges()
+{
+	if (!controllersDirty || soundFont == nullptr)
+		return;
+	
+	for (int channel = 0; channel < NUM_MIDI_CHANNELS; ++channel)
+	{
+		auto& state = channelStates[channel];
+		
+		if (state.volumeDirty || state.panDirty || state.vibratoDirty || state.pitchDirty)
+		{
+			// Passed on to every note channel the MIDI channel owns, release tails included
+			for (int index = 0; index < NUM_NOTE_CHANNELS; ++index)
+				if (noteChannels[static_cast<size_t>(index)].midiChannel == channel)
+					applyControllers(index, state.volumeDirty, state.panDirty, state.vibratoDirty, state.pitchDirty);
+		}
+		
+		state.pitchDirty = state.volumeDirty = state.panDirty = state.vibratoDirty = false;
+	}
+	
+	controllersDirty = false;
+}
+
+void SoundFontPlayer::applyControllers(int noteChannel, bool volume, bool pan, bool vibrato, bool pitch)
+{
+	const auto& state = channelStates[noteChannels[static_cast<size_t>(noteChannel)].midiChannel];
+	const int tsfChannel = tsfChannelOf(noteChannel);
+	
+	if (volume)
+	{
+		// Same curve tsf applies to CC 7/11: cube of the combined volume and expression
+		const float gain = (state.volume / 16383.0f) * (state.expression / 16383.0f);
+		tsf_channel_set_volume(soundFont, tsfChannel, gain * gain * gain);
+	}
+	
+	if (pan)
+		tsf_channel_set_pan(soundFont, tsfChannel, state.pan / 16383.0f);
+	
+	if (vibrato)
+	{
+		tsf_channel_set_modwheel(soundFont, tsfChannel, state.modWheel);
+		tsf_channel_set_pressure(soundFont, tsfChannel, state.pressure);
+	}
+	
+	if (pitch)
+		applyNotePitch(noteChannel);
+}
+
+void SoundFontPlayer::applyNotePitch(int noteChannel, bool glide)
+{
+	auto& channel = noteChannels[static_cast<size_t>(noteChannel)];
+	const auto& state = channelStates[channel.midiChannel];
+	const int tsfChannel = tsfChannelOf(noteChannel);
+	
+	// Covers both the range and the wheel change below, so the glide starts from the pitch sounding now
+	if (glide)
+		tsf_channel_set_pitchglide(soundFont, tsfChannel, static_cast<float>(retuneGlideMs * 0.001));
+	
+	// Incoming pitch wheel on top of the just intonation offset
+	const double bendSemitones = (state.pitchWheel - 8192) / 8192.0 * state.pitchBendRange;
+	const double semitones = channel.tuningOffset + bendSemitones;
+	
+	// The tsf range must hold the worst case of the tuning table plus a full user bend.
+	// Keep it to whole semitones and no wider than needed, since the 14-bit wheel
+	// resolution is spread across it.
+	const float requiredRange = juce::jmax(MIN_TSF_PITCH_RANGE,
+		static_cast<float>(std::ceil(maxTuningDeviation + state.pitchBendRange - 1.0e-6)));
+	
+	if (requiredRange != channel.tsfPitchRange)
+	{
+		tsf_channel_set_pitchrange(soundFont, tsfChannel, requiredRange);
+		channel.tsfPitchRange = requiredRange;
+	}
+	
+	// tsf maps 0..16383 linearly onto -range..+range semitones
+	const double range = channel.tsfPitchRange;
+	const int pitchWheel = juce::roundToInt((semitones + range) / (2.0 * range) * 16383.0);
+	tsf_channel_set_pitchwheel(soundFont, tsfChannel, juce::jlimit(0, 16383, pitchWheel));
+	
+	if (glide)
+		tsf_channel_set_pitchglide(soundFont, tsfChannel, 0.0f);
+}
+
+//==============================================================================
+void SoundFontPlayer::setNoteFrequency(int midiNote, double frequencyHz)
+{
+	if (!juce::isPositiveAndBelow(midiNote, 128))
+		return;
+	
+	juce::ScopedLock sl(lock);
+	noteFrequencyMap[static_cast<size_t>(midiNote)] = frequencyHz;
+	updateMaxTuningDeviation();
+}
+
+void SoundFontPlayer::updateFrequencyMapping(const std::array<double, 128>& midiNoteToFreqMap)
+{
+	juce::ScopedLock sl(lock);
+	
+	// The processor calls this whenever a setting or the measure changes, which often leaves
+	// the tuning as it was (e.g. a new measure with the same root), so skip that case
+	if (midiNoteToFreqMap == noteFrequencyMap)
+		return;
+	
+	noteFrequencyMap = midiNoteToFreqMap;
+	updateMaxTuningDeviation();
+	
+	if (soundFont == nullptr)
+		return;
+	
+	// Glide the sounding notes whose frequency changed, each on its own channel
+	for (int index = 0; index < NUM_NOTE_CHANNELS; ++index)
+	{
+		auto& channel = noteChannels[static_cast<size_t>(index)];
+		if (!isSounding(channel) || channel.percussion)
+			continue;
+		
+		const double frequency = noteFrequencyMap[static_cast<size_t>(channel.midiNote)];
+		if (frequency > 0.0 && std::abs(channel.targetFrequency - frequency) > 0.01)
+		{
+			channel.targetFrequency = frequency;
+			channel.tuningOffset = calculateTuningOffset(channel.midiNote, channel.targetFrequency);
+			applyNotePitch(index, true);
 		}
 	}
 }
@@ -268,7 +1078,25 @@ void SoundFontPlayer::updateFrequencyMapping(const std::map<int, double>& midiNo
 void SoundFontPlayer::clearCustomTuning()
 {
 	juce::ScopedLock sl(lock);
-	noteFrequencyMap.clear();
+	noteFrequencyMap.fill(0.0);
+	updateMaxTuningDeviation();
+}
+
+void SoundFontPlayer::updateMaxTuningDeviation()
+{
+	maxTuningDeviation = 0.0;
+	
+	for (int note = 0; note < 128; ++note)
+	{
+		const double frequency = noteFrequencyMap[static_cast<size_t>(note)];
+		if (frequency > 0.0)
+			maxTuningDeviation = juce::jmax(maxTuningDeviation, std::abs(calculateTuningOffset(note, frequency)));
+	}
+	
+	// Retune every channel so each picks up its new range at the next flush
+	for (auto& state : channelStates)
+		state.pitchDirty = true;
+	controllersDirty = true;
 }
 
 //==============================================================================
@@ -279,22 +1107,31 @@ void SoundFontPlayer::renderNextBlock(juce::AudioBuffer<float>& buffer, int star
 	if (soundFont == nullptr || numSamples <= 0)
 		return;
 	
-	// Create interleaved buffer for tinysoundfont
-	std::vector<float> interleavedBuffer(numSamples * 2);
-	
-	// Render audio
-	tsf_render_float(soundFont, interleavedBuffer.data(), numSamples, 0);
-	
-	// Deinterleave to JUCE buffer
 	float* leftChannel = buffer.getWritePointer(0, startSample);
 	float* rightChannel = buffer.getNumChannels() > 1 ? 
 						  buffer.getWritePointer(1, startSample) : nullptr;
 	
-	for (int i = 0; i < numSamples; ++i)
+	// Render through the preallocated interleaved buffer, in chunks if the host
+	// hands us a bigger block than announced in prepareToPlay
+	const int maxChunkSamples = static_cast<int>(interleavedBuffer.size() / 2);
+	
+	while (numSamples > 0)
 	{
-		leftChannel[i] += interleavedBuffer[i * 2];
+		const int chunkSamples = juce::jmin(numSamples, maxChunkSamples);
+		tsf_render_float(soundFont, interleavedBuffer.data(), chunkSamples, 0);
+		
+		// Deinterleave to JUCE buffer
+		for (int i = 0; i < chunkSamples; ++i)
+		{
+			leftChannel[i] += interleavedBuffer[i * 2];
+			if (rightChannel != nullptr)
+				rightChannel[i] += interleavedBuffer[i * 2 + 1];
+		}
+		
+		leftChannel += chunkSamples;
 		if (rightChannel != nullptr)
-			rightChannel[i] += interleavedBuffer[i * 2 + 1];
+			rightChannel += chunkSamples;
+		numSamples -= chunkSamples;
 	}
 }
 
@@ -302,51 +1139,102 @@ void SoundFontPlayer::renderNextBlock(juce::AudioBuffer<float>& buffer,
 									  const juce::MidiBuffer& midiMessages,
 									  int startSample, int numSamples)
 {
-	// Process MIDI messages
-	for (const auto metadata : midiMessages)
+	juce::ScopedLock sl(lock);
+	
+	const int endSample = startSample + numSamples;
+	
+	// Only the events inside this range, the processor splits blocks at bar lines and
+	// renders each part with the same buffer
+	for (auto it = midiMessages.findNextSamplePosition(startSample); it != midiMessages.end(); ++it)
 	{
+		const auto metadata = *it;
+		if (metadata.samplePosition >= endSample)
+			break;
+		
 		const auto msg = metadata.getMessage();
 		const int samplePosition = metadata.samplePosition;
+		const auto timing = getEventTiming(msg);
+		
+		// Split the render only where an event changes what is sounding. Controllers arriving
+		// within CONTROLLER_SPLIT_INTERVAL of the last split take effect at that split instead,
+		// so dense controller streams can't fragment the block into tiny renders.
+		const bool shouldSplit = timing == EventTiming::SampleAccurate
+							  || (timing == EventTiming::Quantised && samplePosition - startSample >= CONTROLLER_SPLIT_INTERVAL);
 		
 		// Render audio up to this MIDI event
-		if (samplePosition > startSample)
+		if (shouldSplit && samplePosition > startSample)
 		{
+			flushControllerChanges();
 			renderNextBlock(buffer, startSample, samplePosition - startSample);
-			numSamples -= (samplePosition - startSample);
 			startSample = samplePosition;
 		}
 		
-		// Process the MIDI message
-		if (msg.isNoteOn())
-		{
-			noteOn(msg.getChannel() - 1, msg.getNoteNumber(), msg.getFloatVelocity());
-		}
-		else if (msg.isNoteOff())
-		{
-			noteOff(msg.getChannel() - 1, msg.getNoteNumber());
-		}
-		else if (msg.isAllNotesOff() || msg.isAllSoundOff())
-		{
-			allNotesOff();
-		}
-		else if (msg.isController())
-		{
-			// Handle CC messages if needed
-			if (soundFont != nullptr)
-			{
-				tsf_channel_midi_control(soundFont, msg.getChannel() - 1,
-					msg.getControllerNumber(), msg.getControllerValue());
-			}
-		}
+		handleMidiEvent(msg);
 	}
 	
 	// Render remaining audio
-	if (numSamples > 0)
+	flushControllerChanges();
+	if (endSample > startSample)
 	{
-		renderNextBlock(buffer, startSample, numSamples);
+		renderNextBlock(buffer, startSample, endSample - startSample);
 	}
 }
 
+SoundFontPlayer::EventTiming SoundFontPlayer::getEventTiming(const juce::MidiMessage& message)
+{
+	if (message.isNoteOnOrOff() || message.isProgramChange())
+		return EventTiming::SampleAccurate;
+	
+	if (message.isPitchWheel() || message.isChannelPressure())
+		return EventTiming::Quantised;
+	
+	if (message.isController())
+	{
+		switch (message.getControllerNumber())
+		{
+			case 64:  // Sustain
+			case 120: // All sound off
+			case 121: // Reset all controllers
+			case 123: // All notes off
+				return EventTiming::SampleAccurate;
+			
+			case 1:  case 33: // Modulation
+			case 7:  case 39: // Volume
+			case 10: case 42: // Pan
+			case 11: case 43: // Expression
+			case 6:  case 38: // Data entry
+				return EventTiming::Quantised;
+			
+			default:
+				return EventTiming::Immediate;
+		}
+	}
+	
+	return EventTiming::Immediate;
+}
+
+void SoundFontPlayer::handleMidiEvent(const juce::MidiMessage& message)
+{
+	const int midiChannel = message.getChannel() - 1;
+	
+	// System messages carry no channel
+	if (!juce::isPositiveAndBelow(midiChannel, NUM_MIDI_CHANNELS))
+		return;
+	
+	if (message.isNoteOn())
+		noteOn(midiChannel, message.getNoteNumber(), message.getFloatVelocity());
+	else if (message.isNoteOff())
+		noteOff(midiChannel, message.getNoteNumber());
+	else if (message.isPitchWheel())
+		pitchWheelMoved(midiChannel, message.getPitchWheelValue());
+	else if (message.isChannelPressure())
+		channelPressureChanged(midiChannel, message.getChannelPressureValue());
+	else if (message.isProgramChange())
+		programChange(midiChannel, message.getProgramChangeNumber());
+	else if (message.isController())
+		controllerMoved(midiChannel, message.getControllerNumber(), message.getControllerValue());
+}
+
 //==============================================================================
 void SoundFontPlayer::setGlobalGain(float gainLinear)
 {
@@ -362,31 +1250,63 @@ void SoundFontPlayer::setGlobalGain(float gainLinear)
 
 void SoundFontPlayer::setMaxPolyphony(int maxVoices)
 {
+	maxVoices = juce::jlimit(MIN_POLYPHONY, MAX_POLYPHONY, maxVoices);
+	
+	if (maxVoices == maxPolyphony)
+		return;
+	
+	// May reallocate the voices the streaming thread is reading into. streamLock is always
+	// taken before lock.
+	juce::ScopedLock ssl(streamLock);
 	juce::ScopedLock sl(lock);
 	
 	maxPolyphony = maxVoices;
 	
 	if (soundFont != nullptr)
-	{
 		tsf_set_max_voices(soundFont, maxPolyphony);
+}
+
+void SoundFontPlayer::setControlBlockSize(int samples)
+{
+	juce::ScopedLock sl(lock);
+	
+	controlBlockSize = samples <= 0 ? 0 : juce::jlimit(MIN_CONTROL_BLOCK_SIZE, MAX_CONTROL_BLOCK_SIZE, juce::nextPowerOfTwo(samples));
+	applyControlBlockSize();
+}
+
+void SoundFontPlayer::setRetuneGlideTime(double milliseconds)
+{
+	juce::ScopedLock sl(lock);
+	retuneGlideMs = juce::jmax(0.0, milliseconds);
+}
+
+void SoundFontPlayer::applyControlBlockSize()
+{
+	if (soundFont == nullptr)
+		return;
+	
+	int samples = controlBlockSize;
+	
+	if (samples == 0)
+	{
+		// Largest block that still updates at TARGET_CONTROL_RATE_HZ:
+		// 32 samples at 22.05kHz, 64 at 44.1/48kHz, 128 at 88.2/96kHz
+		samples = MIN_CONTROL_BLOCK_SIZE;
+		while (samples < MAX_CONTROL_BLOCK_SIZE && sampleRate / (samples * 2) >= TARGET_CONTROL_RATE_HZ)
+			samples *= 2;
 	}
+	
+	tsf_set_effect_block(soundFont, samples);
 }
 
 //==============================================================================
-float SoundFontPlayer::calculatePitchBendForFrequency(int midiNote, double targetFrequency)
+double SoundFontPlayer::calculateTuningOffset(int midiNote, double targetFrequency) const
 {
 	// Calculate the standard frequency for this MIDI note
 	double standardFreq = getMidiNoteFrequency(midiNote);
 	
-	// Calculate the pitch bend in semitones
-	double semitones = 12.0 * std::log2(targetFrequency / standardFreq);
-	
-	// Convert to pitch bend range (-1 to 1, where 1 = +2 semitones by default)
-	// tinysoundfont default pitch bend range is 2 semitones
-	float pitchBend = static_cast<float>(semitones / 2.0);
-	
-	// Clamp to valid range
-	return juce::jlimit(-1.0f, 1.0f, pitchBend);
+	// Offset from it in semitones
+	return 12.0 * std::log2(targetFrequency / standardFreq);
 }
 
 double SoundFontPlayer::getMidiNoteFrequency(int midiNote) const
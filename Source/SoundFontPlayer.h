@@ -1,6 +1,8 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include <array>
+#include <atomic>
 #include <map>
 #include <memory>
 #include <vector>
@@ -13,7 +15,7 @@ struct tsf;
  * SoundFontPlayer - Handles loading and playing soundfonts with custom tuning support
  * Uses tinysoundfont library for SF2 file parsing and rendering
  */
-class SoundFontPlayer
+class SoundFontPlayer : private juce::TimeSliceClient
 {
 public:
 	//==============================================================================
@@ -31,17 +33,47 @@ public:
 	bool loadSoundFont(const void* data, int sizeInBytes);
 	void unloadSoundFont();
 	bool isSoundFontLoaded() const { return soundFont != nullptr; }
+	
+	// Files are loaded in two phases: presets are available as soon as loadSoundFont returns,
+	// the sample data follows on the background thread. Notes of presets whose samples
+	// aren't in memory yet are skipped.
+	bool isLoadingSamples() const { return samplesLoading; }
+	bool isPresetLoaded(int presetIndex) const;
+
+	// Disk streaming keeps only the start of each sample in memory and reads the rest
+	// on a background thread while playing. Applies to the next file load; files larger
+	// than STREAMING_SIZE_THRESHOLD are always streamed. The underrun count is the number of
+	// blocks in which a voice ran out of streamed data since the file was loaded.
+	void setDiskStreamingEnabled(bool shouldStream) { diskStreamingEnabled = shouldStream; }
+	bool isDiskStreamingEnabled() const { return diskStreamingEnabled; }
+	bool isStreaming() const { return streaming; }
+	int getStreamUnderrunCount() const;
+	
+	// Octave-decimated sample tables for notes played far above their root key. Built in the
+	// background after loading, notes use them as soon as they are ready.
+	void setSampleMipmapsEnabled(bool shouldUseMipmaps);
+	bool areSampleMipmapsEnabled() const { return sampleMipmapsEnabled; }
+	
+	// Files that are loaded fully are saved to a cache in the user's application data after
+	// the first load, later loads of the same file map the cache instead of parsing it. The
+	// cache holds up to BANK_CACHE_SIZE_LIMIT bytes, the least recently used files are removed
+	// to make room. Disabling it cancels a write in progress.
+	void setBankCacheEnabled(bool shouldCache);
+	bool isBankCacheEnabled() const { return bankCacheEnabled; }
 
 	// Get info about the loaded soundfont
 	juce::String getSoundFontName() const { return soundFontName; }
 	juce::File getSoundFontFile() const { return soundFontFile; }
 
 	//==============================================================================
-	// Preset management
+	// Preset management. Every MIDI channel has its own preset, changed by program change
+	// and bank select. setPreset puts the preset on all of them except channel 10, which
+	// starts on the bank's drum kit when it has one.
 	int getPresetCount() const;
 	juce::String getPresetName(int presetIndex) const;
 	void setPreset(int presetIndex);
 	int getCurrentPreset() const { return currentPreset; }
+	int getChannelPreset(int midiChannel) const;
 
 	// Bank selection (for soundfonts with multiple banks)
 	void setBank(int bank);
@@ -53,10 +85,20 @@ public:
 	void noteOff(int midiChannel, int midiNote);
 	void allNotesOff();
 
+	// Number of tsf voices still rendering (including release tails)
+	int getActiveVoiceCount() const;
+
+	//==============================================================================
+	// MIDI channel messages
+	void programChange(int midiChannel, int programNumber);
+	void pitchWheelMoved(int midiChannel, int pitchWheelValue);
+	void channelPressureChanged(int midiChannel, int pressure);
+	void controllerMoved(int midiChannel, int controllerNumber, int controllerValue);
+
 	//==============================================================================
 	// Custom tuning support for just intonation
 	void setNoteFrequency(int midiNote, double frequencyHz);
-	void updateFrequencyMapping(const std::map<int, double>& midiNoteToFreqMap);
+	void updateFrequencyMapping(const std::array<double, 128>& midiNoteToFreqMap);
 	void clearCustomTuning();
 
 	//==============================================================================
@@ -70,8 +112,24 @@ public:
 	void setGlobalGain(float gainLinear);
 	float getGlobalGain() const { return globalGain; }
 
+	// Voices of the tsf instance, a stereo region takes two per note. Call from the message
+	// thread, raising it reallocates the voices and their stream rings (128 KB each while
+	// streaming). Lowering it applies from the next load.
 	void setMaxPolyphony(int maxVoices);
 	int getMaxPolyphony() const { return maxPolyphony; }
+	static constexpr int MIN_POLYPHONY = 64;
+	static constexpr int MAX_POLYPHONY = 1024;
+	static constexpr int DEFAULT_POLYPHONY = 512;
+
+	// Samples between envelope/LFO updates (16-128, 0 = chosen from the sample rate in prepareToPlay).
+	// Gain and pitch are interpolated within each block, so larger blocks mainly save CPU.
+	void setControlBlockSize(int samples);
+	int getControlBlockSize() const { return controlBlockSize; }
+
+	// Time in which sounding notes slide to a changed tuning, linearly in cents. Pitch wheel
+	// moves and the pitch of new notes are not glided.
+	void setRetuneGlideTime(double milliseconds);
+	double getRetuneGlideTime() const { return retuneGlideMs; }
 
 private:
 	//==============================================================================
@@ -86,23 +144,122 @@ private:
 	double sampleRate = 44100.0;
 	int blockSize = 512;
 	float globalGain = 1.0f;
-	int maxPolyphony = 64;
+	int maxPolyphony = DEFAULT_POLYPHONY;
+	int controlBlockSize = 0;
+	double retuneGlideMs = 0.0;
 
-	// Custom frequency mapping for just intonation
-	std::map<int, double> noteFrequencyMap;
+	static constexpr int MIN_CONTROL_BLOCK_SIZE = 16;
+	static constexpr int MAX_CONTROL_BLOCK_SIZE = 128;
+	static constexpr double TARGET_CONTROL_RATE_HZ = 600.0;   // Automatic block size keeps at least this update rate
+	void applyControlBlockSize();
 
-	// Track active notes for retuning
-	struct ActiveNote
+	// Custom frequency of each MIDI note for just intonation, 0 where none is set
+	std::array<double, 128> noteFrequencyMap {};
+
+	//==============================================================================
+	// MIDI event routing
+	static constexpr int NUM_MIDI_CHANNELS = 16;
+	static constexpr int DRUM_CHANNEL = 9;                // MIDI channel 10
+	static constexpr int PERCUSSION_BANK = 128;
+	static constexpr int CONTROLLER_SPLIT_INTERVAL = 32;  // Min samples between renders split by controllers
+	static constexpr float MIN_TSF_PITCH_RANGE = 1.0f;    // Smallest tsf pitch wheel range in semitones
+
+	// How an incoming event affects where the block is split for rendering
+	enum class EventTiming
 	{
-		int midiChannel;
-		int midiNote;
-		double targetFrequency;
-		bool needsRetune;
+		SampleAccurate,   // Notes, program changes, sustain, all notes off: render up to the event
+		Quantised,        // Continuous controllers: split only once CONTROLLER_SPLIT_INTERVAL has passed
+		Immediate         // No audible effect on its own (RPN/bank select etc.): never splits
 	};
-	std::vector<ActiveNote> activeNotes;
+	static EventTiming getEventTiming(const juce::MidiMessage& message);
+	void handleMidiEvent(const juce::MidiMessage& message);
+
+	// Per-channel controller state. Continuous controllers are coalesced here and
+	// pushed to tsf once per render, so a dense stream costs one voice update per split.
+	struct ChannelState
+	{
+		int pitchWheel = 8192;          // Incoming pitch wheel position (0-16383)
+		float pitchBendRange = 2.0f;    // Incoming pitch wheel range in semitones (RPN 0)
+		int rpn = -1;                   // Selected registered parameter (-1 = none)
+		int volume = 16383;             // CC 7/39
+		int expression = 16383;         // CC 11/43
+		int pan = 8192;                 // CC 10/42
+		int modWheel = 0;               // CC 1/33
+		int pressure = 0;               // Channel pressure
+		bool sustain = false;           // CC 64
+		int presetIndex = 0;            // Program, resolved against the channel's bank select
+		bool percussion = false;        // Drum kit preset: notes keep their pitch and aren't retuned
+		bool pitchDirty = false;
+		bool volumeDirty = false;
+		bool panDirty = false;
+		bool vibratoDirty = false;
+	};
+	std::array<ChannelState, NUM_MIDI_CHANNELS> channelStates;
+	bool controllersDirty = false;
+
+	void resetChannelControllers(int midiChannel);
+	void flushControllerChanges();
+	void setSustain(int midiChannel, bool sustainOn);
+
+	// Puts a preset on a MIDI channel; the note channels pick it up at their next note
+	void setChannelPreset(int midiChannel, int presetIndex);
+
+	// The current preset on every channel, the drum kit on channel 10
+	void resetChannelPresets();
+
+	// Notes don't play on their MIDI channel but each on a tsf note channel of its own, so
+	// every note of a chord carries its own just intonation bend. The MIDI channels keep
+	// the program, bank and RPN tuning in tsf and their controllers in channelStates, and
+	// both are mirrored onto the note channels they own. All tsf channels are allocated
+	// when the soundfont loads.
+	static constexpr int NUM_NOTE_CHANNELS = 64;
+	static constexpr int FIRST_NOTE_CHANNEL = NUM_MIDI_CHANNELS;
+	static constexpr int NUM_TSF_CHANNELS = NUM_MIDI_CHANNELS + NUM_NOTE_CHANNELS;
+
+	struct NoteChannel
+	{
+		int midiChannel = -1;           // Owner, kept after the note ends so the tail still follows its controllers
+		int midiNote = -1;
+		bool keyDown = false;
+		bool sustained = false;         // Released while the owner's sustain pedal was down
+		bool percussion = false;        // Started on a drum kit, keeps its pitch when the tuning changes
+		int presetIndex = -1;           // Preset last set on the tsf channel
+		double targetFrequency = 0.0;
+		double tuningOffset = 0.0;      // Just intonation offset of the note in semitones
+		float tsfPitchRange = 2.0f;     // Pitch wheel range currently set on the tsf channel (tsf default)
+		juce::uint32 lastUsed = 0;      // When the note started, or when it ended once released
+	};
+	std::array<NoteChannel, NUM_NOTE_CHANNELS> noteChannels;
+	juce::uint32 noteEventCounter = 0;
+
+	static int tsfChannelOf(int noteChannel) { return FIRST_NOTE_CHANNEL + noteChannel; }
+
+	// Still held by its key or by the owner's sustain pedal
+	static bool isSounding(const NoteChannel& channel) { return channel.keyDown || channel.sustained; }
 
-	// Helper to calculate pitch bend for custom frequency
-	float calculatePitchBendForFrequency(int midiNote, double targetFrequency);
+	// The free note channel released longest ago, so release tails can finish before it is
+	// bent again. When every channel is sounding, the one holding the oldest note.
+	int allocateNoteChannel() const;
+	int findNoteChannel(int midiChannel, int midiNote) const;
+
+	// Push the owner's controllers to a note channel, only the given groups
+	void applyControllers(int noteChannel, bool volume, bool pan, bool vibrato, bool pitch);
+
+	// Largest just intonation offset in the current frequency map, in semitones.
+	// Recomputed only when the map changes; sizes the tsf pitch wheel range.
+	double maxTuningDeviation = 0.0;
+	void updateMaxTuningDeviation();
+
+	// Push the owner's pitch wheel plus the note's tuning offset to a note channel, widening
+	// or narrowing its tsf pitch range so the result is never clamped. With glide the
+	// note slides there over the retune glide time.
+	void applyNotePitch(int noteChannel, bool glide = false);
+
+	// Helper to calculate the tuning offset in semitones for a custom frequency
+	double calculateTuningOffset(int midiNote, double targetFrequency) const;
+
+	// Interleaved scratch buffer for tsf, sized in prepareToPlay
+	std::vector<float> interleavedBuffer;
 
 	// Standard 12-TET frequency calculation
 	double getMidiNoteFrequency(int midiNote) const;
@@ -110,5 +267,65 @@ private:
 	// Critical section for thread safety
 	juce::CriticalSection lock;
 
+	//==============================================================================
+	// Disk streaming
+	static constexpr juce::int64 STREAMING_SIZE_THRESHOLD = 512 * 1024 * 1024;
+	static constexpr float STREAM_PRELOAD_SECONDS = 0.2f;   // Resident start of each sample, covers the first reads
+	static constexpr int STREAM_SERVICE_INTERVAL_MS = 2;
+	static constexpr int STREAM_IDLE_INTERVAL_MS = 20;
+
+	std::atomic<bool> diskStreamingEnabled { false };
+	std::atomic<bool> streaming { false };
+	std::unique_ptr<juce::FileInputStream> streamFile;   // Random access reads for tsf_stream_service
+
+	//==============================================================================
+	// Two-phase loading
+	static constexpr int DEFERRED_LOAD_STEP_SAMPLES = 1 << 20;   // Samples read per background time slice
+
+	std::unique_ptr<juce::FileInputStream> deferredSampleFile;   // Sample reads for tsf_load_deferred_step, released once loaded
+	std::unique_ptr<juce::ThreadPool> decodePool;                // Decodes compressed (SF3) samples, created with the first one
+	std::atomic<bool> samplesLoading { false };
+
+	//==============================================================================
+	// Bank cache
+	static constexpr juce::int64 BANK_CACHE_SIZE_LIMIT = 2048LL * 1024 * 1024;
+
+	std::atomic<bool> bankCacheEnabled { true };
+	std::atomic<bool> cacheWriteCancelled { false };
+	std::unique_ptr<juce::MemoryMappedFile> cacheMapping;   // Backs the tsf instance when it was loaded from the cache
+	juce::File pendingCacheFile;                             // Written by the background thread, guarded by streamLock
+
+	static juce::File getCacheFile(const juce::File& soundFontFile);
+	tsf* loadCached(const juce::File& cacheFile);
+	void writeCache(const tsf* snapshot, const juce::File& cacheFile);
+	static void trimCache(const juce::File& cacheDirectory, juce::int64 spaceNeeded);
+
+	//==============================================================================
+	// Sample mipmaps
+	static constexpr int MIPMAP_LEVELS = 4;   // Covers notes up to four octaves above a sample's root key
+
+	std::atomic<bool> sampleMipmapsEnabled { false };
+	std::atomic<bool> mipmapsPending { false };
+
+	// Guards the tsf instance against the background thread. Taken when the instance is
+	// created, destroyed or its voices reallocated, never on the audio thread. Always taken
+	// before lock, which is held only to swap the instance in and out.
+	juce::CriticalSection streamLock;
+	juce::TimeSliceThread backgroundThread { "SoundFont Background" };
+
+	// Parses the hydra and keeps a second reader open for the samples, which are either
+	// streamed while playing or loaded in the background (two-phase loading)
+	tsf* loadWithSampleReader(const juce::File& file, bool streamSamples);
+
+	// Loads the presets of a file with compressed (SF3) samples, which the background thread
+	// then decodes with JUCE's Ogg Vorbis reader spread over all cores
+	tsf* loadDecoded(const juce::File& file);
+	void startBackgroundWork();
+	int useTimeSlice() override;
+	
+	// The loading, mipmap and streaming work of a time slice, under streamLock. Hands out a
+	// copy of the instance when a cache file is due, which useTimeSlice writes unlocked.
+	int serviceSoundFont(tsf*& cacheSnapshot, juce::File& cacheFile);
+
 	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SoundFontPlayer)
 };
\ No newline at end of file
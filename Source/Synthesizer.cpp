@@ -1,17 +1,81 @@
 #include "Synthesizer.h"
 
+namespace
+{
+	constexpr double cycleScale = 4294967296.0;   // Fixed point phase units per cycle
+	
+	// sin(2 pi phase) for a 32 bit fixed point fraction of a cycle, without libm calls or branches so
+	// loops over it vectorize. Read as signed, the phase is x in [-0.5, 0.5) cycles, then |x| is folded
+	// to a quarter wave, where an odd polynomial up to x^11 is accurate to float precision.
+	inline float sineOfPhase(juce::uint32 phase)
+	{
+		const float x = static_cast<float>(static_cast<juce::int32>(phase)) * static_cast<float>(1.0 / cycleScale);
+		const float a = std::abs(x);
+		const float w = juce::MathConstants<float>::twoPi * std::min(a, 0.5f - a);
+		const float w2 = w * w;
+		const float s = w * (1.0f + w2 * (-1.0f / 6.0f + w2 * (1.0f / 120.0f + w2 * (-1.0f / 5040.0f
+						  + w2 * (1.0f / 362880.0f + w2 * (-1.0f / 39916800.0f))))));
+		return x < 0.0f ? -s : s;
+	}
+	
+	// Waveforms for the bank's render loops
+	struct SineWaveform
+	{
+		float operator()(juce::uint32 phase) const { return sineOfPhase(phase); }
+	};
+	
+	struct TableWaveform
+	{
+		const float* table;   // One of the Wavetable's band-limited tables
+		float operator()(juce::uint32 phase) const { return Wavetable::lookup(table, phase); }
+	};
+	
+	// Level times a linear envelope after i + 1 steps, like stepping per sample. Clamped in gain
+	// units, as scaling a clamped envelope stops GCC from vectorizing.
+	inline float envelopeGain(float gain0, float gainStep, float gain, int i)
+	{
+		return std::min(std::max(gain0 + gainStep * static_cast<float>(i + 1), 0.0f), gain);
+	}
+	
+	// Adds the waveform times a linear envelope to mix. The fixed point phase wraps by itself.
+	template <typename Waveform>
+	void addOscillator(float* mix, int numSamples, Waveform waveform, double startPhase, double cyclesPerSample,
+					   double level, double envelope, double envelopeStep)
+	{
+		const auto phase0 = static_cast<juce::uint32>(static_cast<juce::uint64>(startPhase * cycleScale));
+		const auto increment = static_cast<juce::uint32>(static_cast<juce::uint64>(cyclesPerSample * cycleScale + 0.5));
+		const auto gain = static_cast<float>(level);
+		const auto gain0 = static_cast<float>(level * envelope);
+		const auto gainStep = static_cast<float>(level * envelopeStep);
+		
+		for (int i = 0; i < numSamples; ++i)
+			mix[i] += waveform(phase0 + increment * static_cast<juce::uint32>(i)) * envelopeGain(gain0, gainStep, gain, i);
+	}
+	
+	// The same for precomputed fixed point phases
+	template <typename Waveform>
+	void addOscillatorAtPhases(float* mix, int numSamples, Waveform waveform, const juce::uint32* phases,
+							   double level, double envelope, double envelopeStep)
+	{
+		const auto gain = static_cast<float>(level);
+		const auto gain0 = static_cast<float>(level * envelope);
+		const auto gainStep = static_cast<float>(level * envelopeStep);
+		
+		for (int i = 0; i < numSamples; ++i)
+			mix[i] += waveform(phases[i]) * envelopeGain(gain0, gainStep, gain, i);
+	}
+}
+
 //==============================================================================
 FluidJustIntonationSynth::FluidJustIntonationSynth()
 {
 	// Create and add a sound for sine wave mode
 	addSound(new FluidJustSound());
 
-	// Create some voices for sine wave mode
-	for (int i = 0; i < 16; ++i) // 16 voices for polyphony
-		addVoice(new FluidJustVoice());
-
 	// Create the soundfont player
 	soundFontPlayer = std::make_unique<SoundFontPlayer>();
+	
+	wavetable = Wavetable::createSaw();
 }
 
 FluidJustIntonationSynth::~FluidJustIntonationSynth()
@@ -26,6 +90,21 @@ void FluidJustIntonationSynth::setup(double sampleRate, int blockSize)
 	// Setup sine wave synth
 	setCurrentPlaybackSampleRate(sampleRate);
 	
+	// Allocate the whole sine voice pool once, the polyphony limit only selects how much of it is used
+	if (sineVoices.empty())
+	{
+		const juce::ScopedLock sl(lock);
+		
+		sineVoices.reserve(MAX_SINE_VOICES);
+		freeVoiceIndices.reserve(MAX_SINE_VOICES);
+		oscillatorBank.prepare(MAX_SINE_VOICES);
+		
+		for (int i = 0; i < MAX_SINE_VOICES; ++i)
+			sineVoices.push_back(static_cast<FluidJustVoice*>(addVoice(new FluidJustVoice(*this, i))));
+		
+		rebuildFreeVoiceList();
+	}
+	
 	// Setup soundfont player
 	if (soundFontPlayer)
 	{
@@ -36,20 +115,19 @@ void FluidJustIntonationSynth::setup(double sampleRate, int blockSize)
 
 double FluidJustIntonationSynth::getNoteFrequency(int midiNoteNumber)
 {
-	auto it = noteToFrequencyMap.find(midiNoteNumber);
-	if (it != noteToFrequencyMap.end())
-		return it->second;
+	if (juce::isPositiveAndBelow(midiNoteNumber, 128) && noteToFrequencyMap[static_cast<size_t>(midiNoteNumber)] > 0.0)
+		return noteToFrequencyMap[static_cast<size_t>(midiNoteNumber)];
 
 	// Default to standard 12-TET tuning if no custom frequency is defined
 	return juce::MidiMessage::getMidiNoteInHertz(midiNoteNumber);
 }
 
-void FluidJustIntonationSynth::updateFrequencyMapping(const std::map<int, double>& midiNoteToFreqMap)
+void FluidJustIntonationSynth::updateFrequencyMapping(const std::array<double, 128>& midiNoteToFreqMap)
 {
 	noteToFrequencyMap = midiNoteToFreqMap;
 	
 	// Update based on current mode
-	if (currentMode == SynthMode::SineWave)
+	if (currentMode == SynthMode::SineWave || currentMode == SynthMode::Wavetable)
 	{
 		updatePlayingVoices();
 	}
@@ -61,26 +139,367 @@ void FluidJustIntonationSynth::updateFrequencyMapping(const std::map<int, double
 
 void FluidJustIntonationSynth::updatePlayingVoices()
 {
-	// Update all currently playing sine wave voices to the new tuning
-	for (int i = 0; i < getNumVoices(); ++i)
+	// Update all currently playing sine and wavetable voices to the new tuning
+	for (auto* voice : sineVoices)
 	{
-		if (auto* voice = dynamic_cast<FluidJustVoice*>(getVoice(i)))
+		if (voice->isVoiceActive())
 		{
-			if (voice->isVoiceActive())
+			// Get the current MIDI note this voice is playing
+			int midiNote = voice->getCurrentlyPlayingNote();
+			if (midiNote >= 0)
 			{
-				// Get the current MIDI note this voice is playing
-				int midiNote = voice->getCurrentlyPlayingNote();
-				if (midiNote >= 0)
-				{
-					// Update to the new frequency
-					double freq = getNoteFrequency(midiNote);
-					voice->setCustomFrequency(freq);
-				}
+				// Update to the new frequency
+				double freq = getNoteFrequency(midiNote);
+				voice->setCustomFrequency(freq);
 			}
 		}
 	}
 }
 
+bool FluidJustIntonationSynth::isActive() const
+{
+	if (currentMode == SynthMode::SoundFont)
+		return soundFontPlayer && soundFontPlayer->getActiveVoiceCount() > 0;
+	
+	for (auto* voice : sineVoices)
+	{
+		if (voice->isVoiceActive())
+			return true;
+	}
+	
+	return false;
+}
+
+//==============================================================================
+void FluidJustIntonationSynth::setMaxPolyphony(int maxVoices)
+{
+	const juce::ScopedLock sl(lock);
+	
+	maxPolyphony = juce::jlimit(1, MAX_SINE_VOICES, maxVoices);
+	
+	// Let voices above the new limit ring out, they aren't reused once they finish
+	for (auto* voice : sineVoices)
+		if (voice->poolIndex >= maxPolyphony && voice->isVoiceActive())
+			voice->stopNote(0.0f, true);
+	
+	rebuildFreeVoiceList();
+}
+
+void FluidJustIntonationSynth::setRetuneGlideTime(double milliseconds)
+{
+	retuneGlideMs = juce::jlimit(0.0, MAX_RETUNE_GLIDE_MS, milliseconds);
+	
+	if (soundFontPlayer)
+		soundFontPlayer->setRetuneGlideTime(retuneGlideMs);
+}
+
+void FluidJustIntonationSynth::setControlBlockSize(int samples)
+{
+	if (soundFontPlayer)
+		soundFontPlayer->setControlBlockSize(samples);
+}
+
+int FluidJustIntonationSynth::getControlBlockSize() const
+{
+	return soundFontPlayer ? soundFontPlayer->getControlBlockSize() : 0;
+}
+
+void FluidJustIntonationSynth::markVoiceFree(FluidJustVoice& voice)
+{
+	removeFromList(voice);
+	
+	if (voice.freeListPosition >= 0 || voice.poolIndex >= maxPolyphony)
+		return;
+	
+	voice.freeListPosition = static_cast<int>(freeVoiceIndices.size());
+	freeVoiceIndices.push_back(voice.poolIndex);
+}
+
+void FluidJustIntonationSynth::markVoiceBusy(FluidJustVoice& voice)
+{
+	removeFromList(voice);
+	appendToList(heldVoices, voice);
+	
+	if (voice.freeListPosition < 0)
+		return;
+	
+	// Move the last entry into the voice's slot
+	const int lastIndex = freeVoiceIndices.back();
+	freeVoiceIndices[static_cast<size_t>(voice.freeListPosition)] = lastIndex;
+	sineVoices[static_cast<size_t>(lastIndex)]->freeListPosition = voice.freeListPosition;
+	freeVoiceIndices.pop_back();
+	voice.freeListPosition = -1;
+}
+
+void FluidJustIntonationSynth::markVoiceReleasing(FluidJustVoice& voice)
+{
+	// A second note-off keeps the voice's place among the released ones
+	if (voice.list != &heldVoices)
+		return;
+	
+	removeFromList(voice);
+	appendToList(releasingVoices, voice);
+}
+
+void FluidJustIntonationSynth::appendToList(VoiceList& list, FluidJustVoice& voice)
+{
+	voice.list = &list;
+	voice.previousInList = list.last;
+	voice.nextInList = -1;
+	
+	if (list.last >= 0)
+		sineVoices[static_cast<size_t>(list.last)]->nextInList = voice.poolIndex;
+	else
+		list.first = voice.poolIndex;
+	
+	list.last = voice.poolIndex;
+}
+
+void FluidJustIntonationSynth::removeFromList(FluidJustVoice& voice)
+{
+	if (voice.list == nullptr)
+		return;
+	
+	auto& list = *voice.list;
+	
+	if (voice.previousInList >= 0)
+		sineVoices[static_cast<size_t>(voice.previousInList)]->nextInList = voice.nextInList;
+	else
+		list.first = voice.nextInList;
+	
+	if (voice.nextInList >= 0)
+		sineVoices[static_cast<size_t>(voice.nextInList)]->previousInList = voice.previousInList;
+	else
+		list.last = voice.previousInList;
+	
+	voice.list = nullptr;
+	voice.previousInList = -1;
+	voice.nextInList = -1;
+}
+
+void FluidJustIntonationSynth::rebuildFreeVoiceList()
+{
+	freeVoiceIndices.clear();
+	
+	for (auto* voice : sineVoices)
+	{
+		voice->freeListPosition = -1;
+		
+		if (!voice->isVoiceActive())
+			markVoiceFree(*voice);
+	}
+}
+
+juce::SynthesiserVoice* FluidJustIntonationSynth::findFreeVoice(juce::SynthesiserSound*, int, int,
+																 bool stealIfNoneAvailable) const
+{
+	// The voice is taken off the free list when it starts
+	if (!freeVoiceIndices.empty())
+		return sineVoices[static_cast<size_t>(freeVoiceIndices.back())];
+	
+	if (!stealIfNoneAvailable)
+		return nullptr;
+	
+	// The first voice of each list is taken, only voices above a lowered limit, which ring
+	// out without being reused, are passed over
+	for (const VoiceList* list : { &releasingVoices, &heldVoices })
+	{
+		for (int index = list->first; index >= 0; index = sineVoices[static_cast<size_t>(index)]->nextInList)
+		{
+			if (index < maxPolyphony)
+				return sineVoices[static_cast<size_t>(index)];
+		}
+	}
+	
+	return nullptr;
+}
+
+void FluidJustIntonationSynth::renderVoices(juce::AudioBuffer<float>& outputBuffer, int startSample, int numSamples)
+{
+	// All oscillators are mixed into one mono buffer, then added to each channel in one go
+	float mix[OscillatorBank::RENDER_CHUNK_SIZE];
+	int finished[MAX_SINE_VOICES];
+	
+	while (numSamples > 0)
+	{
+		const int chunkSize = juce::jmin(numSamples, OscillatorBank::RENDER_CHUNK_SIZE);
+		
+		std::fill(mix, mix + chunkSize, 0.0f);
+		const int numFinished = oscillatorBank.render(mix, chunkSize, finished);
+		
+		for (int channel = 0; channel < outputBuffer.getNumChannels(); ++channel)
+			outputBuffer.addFrom(channel, startSample, mix, chunkSize);
+		
+		for (int i = 0; i < numFinished; ++i)
+			sineVoices[static_cast<size_t>(finished[i])]->finishNote();
+		
+		startSample += chunkSize;
+		numSamples -= chunkSize;
+	}
+}
+
+//==============================================================================
+// OscillatorBank implementation
+
+void FluidJustIntonationSynth::OscillatorBank::prepare(int numOscillators)
+{
+	const auto size = static_cast<size_t>(numOscillators);
+	
+	phases.assign(size, 0.0);
+	increments.assign(size, 0.0);
+	glideRatios.assign(size, 1.0);
+	glideTargets.assign(size, 0.0);
+	glideSamples.assign(size, 0);
+	levels.assign(size, 0.0);
+	envelopes.assign(size, 0.0);
+	envelopeSteps.assign(size, 0.0);
+	activeIndices.clear();
+	activeIndices.reserve(size);
+	activePositions.assign(size, -1);
+}
+
+void FluidJustIntonationSynth::OscillatorBank::start(int index, double cyclesPerSample, double level, double attackRate)
+{
+	const auto i = static_cast<size_t>(index);
+	
+	// Reset phase to avoid clicks
+	phases[i] = 0.0;
+	increments[i] = cyclesPerSample;
+	glideSamples[i] = 0;
+	levels[i] = level;
+	envelopes[i] = 0.0;
+	envelopeSteps[i] = attackRate;
+	
+	if (activePositions[i] < 0)
+	{
+		activePositions[i] = static_cast<int>(activeIndices.size());
+		activeIndices.push_back(index);
+	}
+}
+
+void FluidJustIntonationSynth::OscillatorBank::release(int index, double releaseRate)
+{
+	envelopeSteps[static_cast<size_t>(index)] = -releaseRate;
+}
+
+void FluidJustIntonationSynth::OscillatorBank::glideTo(int index, double cyclesPerSample, int numSamples)
+{
+	const auto i = static_cast<size_t>(index);
+	
+	if (numSamples <= 0 || activePositions[i] < 0)
+	{
+		increments[i] = cyclesPerSample;
+		glideSamples[i] = 0;
+		return;
+	}
+	
+	// From the increment sounding now, which is part way along if an earlier glide is still running
+	glideTargets[i] = cyclesPerSample;
+	glideRatios[i] = std::pow(cyclesPerSample / increments[i], 1.0 / numSamples);
+	glideSamples[i] = numSamples;
+}
+
+void FluidJustIntonationSynth::OscillatorBank::stop(int index)
+{
+	const auto i = static_cast<size_t>(index);
+	const int position = activePositions[i];
+	
+	levels[i] = 0.0;
+	envelopes[i] = 0.0;
+	envelopeSteps[i] = 0.0;
+	
+	if (position < 0)
+		return;
+	
+	// Move the last active oscillator into the freed slot
+	const int lastIndex = activeIndices.back();
+	activeIndices[static_cast<size_t>(position)] = lastIndex;
+	activePositions[static_cast<size_t>(lastIndex)] = position;
+	activeIndices.pop_back();
+	activePositions[i] = -1;
+}
+
+template <typename Waveform>
+void FluidJustIntonationSynth::OscillatorBank::renderOscillator(size_t i, float* mix, int numSamples, Waveform waveform)
+{
+	if (glideSamples[i] <= 0)
+	{
+		addOscillator(mix, numSamples, waveform, phases[i], increments[i], levels[i], envelopes[i], envelopeSteps[i]);
+		
+		// Advance the phase in double precision so long notes keep their exact pitch
+		phases[i] += increments[i] * numSamples;
+		phases[i] -= std::floor(phases[i]);
+		return;
+	}
+	
+	// While gliding the increment changes by the same factor every sample. Summing the phases
+	// is serial, so it is kept out of addOscillator and done only for gliding oscillators.
+	juce::uint32 samplePhases[RENDER_CHUNK_SIZE];
+	const int numGliding = juce::jmin(numSamples, glideSamples[i]);
+	double increment = increments[i];
+	double advance = 0.0;
+	
+	for (int n = 0; n < numSamples; ++n)
+	{
+		samplePhases[n] = static_cast<juce::uint32>(static_cast<juce::uint64>((phases[i] + advance) * cycleScale));
+		advance += increment;
+		
+		if (n < numGliding)
+			increment *= glideRatios[i];
+	}
+	
+	addOscillatorAtPhases(mix, numSamples, waveform, samplePhases, levels[i], envelopes[i], envelopeSteps[i]);
+	
+	phases[i] += advance;
+	phases[i] -= std::floor(phases[i]);
+	
+	glideSamples[i] -= numGliding;
+	increments[i] = glideSamples[i] > 0 ? increment : glideTargets[i];
+}
+
+int FluidJustIntonationSynth::OscillatorBank::render(float* mix, int numSamples, int* finished)
+{
+	int numFinished = 0;
+	
+	// Backwards, so stopping an oscillator only moves one that has already rendered
+	for (int position = static_cast<int>(activeIndices.size()); --position >= 0;)
+	{
+		const int index = activeIndices[static_cast<size_t>(position)];
+		const auto i = static_cast<size_t>(index);
+		
+		if (wavetable != nullptr)
+		{
+			// The table for the highest rate the oscillator reaches in this chunk
+			const double fastest = glideSamples[i] > 0 ? juce::jmax(increments[i], glideTargets[i]) : increments[i];
+			renderOscillator(i, mix, numSamples, TableWaveform { wavetable->getTable(fastest) });
+		}
+		else
+		{
+			renderOscillator(i, mix, numSamples, SineWaveform {});
+		}
+		
+		const double envelope = envelopes[i] + envelopeSteps[i] * numSamples;
+		
+		if (envelope >= 1.0 && envelopeSteps[i] > 0.0)
+		{
+			envelopes[i] = 1.0;
+			envelopeSteps[i] = 0.0;
+		}
+		else if (envelope <= 0.0 && envelopeSteps[i] < 0.0)
+		{
+			stop(index);
+			finished[numFinished++] = index;
+		}
+		else
+		{
+			envelopes[i] = envelope;
+		}
+	}
+	
+	return numFinished;
+}
+
+
 //==============================================================================
 void FluidJustIntonationSynth::setSynthMode(SynthMode mode)
 {
@@ -94,10 +513,14 @@ void FluidJustIntonationSynth::setSynthMode(SynthMode mode)
 			soundFontPlayer->allNotesOff();
 		}
 		
-		currentMode = mode;
+		{
+			const juce::ScopedLock sl(lock);
+			currentMode = mode;
+			oscillatorBank.setWavetable(mode == SynthMode::Wavetable ? wavetable.get() : nullptr);
+		}
 		
 		DBG("FluidJustIntonationSynth: Switched to " + 
-			juce::String(mode == SynthMode::SineWave ? "Sine Wave" : "SoundFont") + " mode");
+			juce::String(mode == SynthMode::SineWave ? "Sine Wave" : mode == SynthMode::Wavetable ? "Wavetable" : "SoundFont") + " mode");
 	}
 }
 
@@ -139,6 +562,11 @@ bool FluidJustIntonationSynth::isSoundFontLoaded() const
 	return soundFontPlayer && soundFontPlayer->isSoundFontLoaded();
 }
 
+bool FluidJustIntonationSynth::isLoadingSoundFontSamples() const
+{
+	return soundFontPlayer && soundFontPlayer->isLoadingSamples();
+}
+
 juce::String FluidJustIntonationSynth::getSoundFontName() const
 {
 	if (soundFontPlayer)
@@ -155,6 +583,45 @@ juce::File FluidJustIntonationSynth::getSoundFontFile() const
 	return juce::File();
 }
 
+void FluidJustIntonationSynth::setSoundFontDiskStreaming(bool shouldStream)
+{
+	if (soundFontPlayer)
+		soundFontPlayer->setDiskStreamingEnabled(shouldStream);
+}
+
+void FluidJustIntonationSynth::setSoundFontBankCache(bool shouldCache)
+{
+	if (soundFontPlayer)
+		soundFontPlayer->setBankCacheEnabled(shouldCache);
+}
+
+void FluidJustIntonationSynth::setSoundFontSampleMipmaps(bool shouldUseMipmaps)
+{
+	if (soundFontPlayer)
+		soundFontPlayer->setSampleMipmapsEnabled(shouldUseMipmaps);
+}
+
+void FluidJustIntonationSynth::setSoundFontPolyphony(int maxVoices)
+{
+	if (soundFontPlayer)
+		soundFontPlayer->setMaxPolyphony(maxVoices);
+}
+
+int FluidJustIntonationSynth::getSoundFontPolyphony() const
+{
+	return soundFontPlayer ? soundFontPlayer->getMaxPolyphony() : SoundFontPlayer::DEFAULT_POLYPHONY;
+}
+
+bool FluidJustIntonationSynth::isSoundFontStreaming() const
+{
+	return soundFontPlayer && soundFontPlayer->isStreaming();
+}
+
+int FluidJustIntonationSynth::getSoundFontStreamUnderruns() const
+{
+	return soundFontPlayer ? soundFontPlayer->getStreamUnderrunCount() : 0;
+}
+
 int FluidJustIntonationSynth::getPresetCount() const
 {
 	if (soundFontPlayer)
@@ -185,14 +652,44 @@ int FluidJustIntonationSynth::getCurrentPreset() const
 	return 0;
 }
 
+int FluidJustIntonationSynth::getChannelPreset(int midiChannel) const
+{
+	if (soundFontPlayer)
+		return soundFontPlayer->getChannelPreset(midiChannel);
+	
+	return 0;
+}
+
+bool FluidJustIntonationSynth::isPresetLoaded(int presetIndex) const
+{
+	return soundFontPlayer && soundFontPlayer->isPresetLoaded(presetIndex);
+}
+
+//==============================================================================
+void FluidJustIntonationSynth::setWavetable(std::unique_ptr<Wavetable> newWavetable)
+{
+	if (newWavetable == nullptr)
+		return;
+	
+	{
+		const juce::ScopedLock sl(lock);
+		std::swap(wavetable, newWavetable);
+		
+		if (currentMode == SynthMode::Wavetable)
+			oscillatorBank.setWavetable(wavetable.get());
+	}
+	
+	// newWavetable now holds the previous table, freed outside the lock
+}
+
 //==============================================================================
 void FluidJustIntonationSynth::renderNextBlock(juce::AudioBuffer<float>& outputBuffer,
 											   const juce::MidiBuffer& midiData,
 											   int startSample, int numSamples)
 {
-	if (currentMode == SynthMode::SineWave)
+	if (currentMode == SynthMode::SineWave || currentMode == SynthMode::Wavetable)
 	{
-		// Use the standard JUCE Synthesiser rendering for sine wave mode
+		// Use the standard JUCE Synthesiser rendering for the sine and wavetable modes
 		juce::Synthesiser::renderNextBlock(outputBuffer, midiData, startSample, numSamples);
 	}
 	else if (currentMode == SynthMode::SoundFont && soundFontPlayer)
@@ -216,8 +713,16 @@ void FluidJustIntonationSynth::setGlobalGain(float gainLinear)
 //==============================================================================
 // FluidJustVoice implementation
 
-FluidJustIntonationSynth::FluidJustVoice::FluidJustVoice()
+FluidJustIntonationSynth::FluidJustVoice::FluidJustVoice(FluidJustIntonationSynth& ownerSynth, int index)
+	: poolIndex(index), owner(ownerSynth)
+{
+}
+
+void FluidJustIntonationSynth::FluidJustVoice::finishNote()
 {
+	owner.oscillatorBank.stop(poolIndex);
+	clearCurrentNote();
+	owner.markVoiceFree(*this);
 }
 
 bool FluidJustIntonationSynth::FluidJustVoice::canPlaySound(juce::SynthesiserSound* sound)
@@ -235,16 +740,9 @@ void FluidJustIntonationSynth::FluidJustVoice::startNote(int midiNoteNumber, flo
 	if (customFrequency > 0.0)
 		frequency = customFrequency;
 	
-	level = velocity * 0.15;
-	
-	// Reset phase to avoid clicks
-	phase = 0.0;
-	
-	// Start attack phase
-	env = 0.0;
-	isAttacking = true;
-	isReleasing = false;
-	tailOff = 0.0;
+	// Start the oscillator in its attack phase
+	owner.oscillatorBank.start(poolIndex, frequency / getSampleRate(), velocity * 0.15, attackRate);
+	owner.markVoiceBusy(*this);
 }
 
 void FluidJustIntonationSynth::FluidJustVoice::stopNote(float /*velocity*/, bool allowTailOff)
@@ -252,14 +750,13 @@ void FluidJustIntonationSynth::FluidJustVoice::stopNote(float /*velocity*/, bool
 	if (allowTailOff)
 	{
 		// Start release phase
-		isReleasing = true;
-		isAttacking = false;
+		owner.oscillatorBank.release(poolIndex, releaseRate);
+		owner.markVoiceReleasing(*this);
 	}
 	else
 	{
 		// Note ended abruptly
-		clearCurrentNote();
-		level = 0.0;
+		finishNote();
 	}
 }
 
@@ -273,52 +770,9 @@ void FluidJustIntonationSynth::FluidJustVoice::controllerMoved(int /*controllerN
 	// Not implemented for this basic synth
 }
 
-void FluidJustIntonationSynth::FluidJustVoice::renderNextBlock(juce::AudioBuffer<float>& outputBuffer, 
-															  int startSample, int numSamples)
+void FluidJustIntonationSynth::FluidJustVoice::renderNextBlock(juce::AudioBuffer<float>&, int, int)
 {
-	if (level <= 0.0)
-		return;
-
-	const double cyclesPerSample = frequency / getSampleRate();
-	
-	while (--numSamples >= 0)
-	{
-		// Simple envelope processing
-		if (isAttacking)
-		{
-			env += attackRate;
-			if (env >= 1.0)
-			{
-				env = 1.0;
-				isAttacking = false;
-			}
-		}
-		else if (isReleasing)
-		{
-			env -= releaseRate;
-			if (env <= 0.0)
-			{
-				env = 0.0;
-				isReleasing = false;
-				clearCurrentNote();
-				break;
-			}
-		}
-		
-		// Generate sine wave
-		const float currentSample = static_cast<float>(std::sin(phase * 2.0 * juce::MathConstants<double>::pi) * level * env);
-		
-		// Add to output
-		for (auto i = outputBuffer.getNumChannels(); --i >= 0;)
-			outputBuffer.addSample(i, startSample, currentSample);
-		
-		// Update phase
-		phase += cyclesPerSample;
-		if (phase >= 1.0)
-			phase -= 1.0;
-		
-		++startSample;
-	}
+	// The synth's renderVoices renders all oscillators at once through the bank
 }
 
 void FluidJustIntonationSynth::FluidJustVoice::setCustomFrequency(double freqHz)
@@ -327,5 +781,9 @@ void FluidJustIntonationSynth::FluidJustVoice::setCustomFrequency(double freqHz)
 	
 	// If note is already playing, update its frequency
 	if (isVoiceActive())
+	{
 		frequency = freqHz;
-}
\ No newline at end of file
+		owner.oscillatorBank.glideTo(poolIndex, frequency / getSampleRate(),
+									 juce::roundToInt(owner.retuneGlideMs * 0.001 * getSampleRate()));
+	}
+}
@@ -2,6 +2,7 @@
 
 #include <JuceHeader.h>
 #include "SoundFontPlayer.h"
+#include "Wavetable.h"
 
 //==============================================================================
 /**
@@ -15,7 +16,8 @@ public:
 	enum class SynthMode
 	{
 		SineWave,       // Original simple sine wave mode
-		SoundFont       // SoundFont-based synthesis
+		SoundFont,      // SoundFont-based synthesis
+		Wavetable       // Band-limited wavetables on the sine voices
 	};
 
 	//==============================================================================
@@ -26,7 +28,10 @@ public:
 	void setup(double sampleRate, int blockSize);
 
 	// Update the frequency mapping for MIDI notes (just intonation)
-	void updateFrequencyMapping(const std::map<int, double>& midiNoteToFreqMap);
+	void updateFrequencyMapping(const std::array<double, 128>& midiNoteToFreqMap);
+
+	// True while any voice of the current engine is still sounding
+	bool isActive() const;
 
 	//==============================================================================
 	// Synthesis mode
@@ -38,15 +43,35 @@ public:
 	bool loadSoundFont(const juce::File& file);
 	void unloadSoundFont();
 	bool isSoundFontLoaded() const;
+	bool isLoadingSoundFontSamples() const;
 	
 	juce::String getSoundFontName() const;
 	juce::File getSoundFontFile() const;
+	
+	// Disk streaming applies to the next load, see SoundFontPlayer
+	void setSoundFontDiskStreaming(bool shouldStream);
+	void setSoundFontBankCache(bool shouldCache);
+	void setSoundFontSampleMipmaps(bool shouldUseMipmaps);
+	void setSoundFontPolyphony(int maxVoices);   // Message thread only, see SoundFontPlayer::setMaxPolyphony
+	int getSoundFontPolyphony() const;
+	bool isSoundFontStreaming() const;
+	int getSoundFontStreamUnderruns() const;
 
 	// Preset management
 	int getPresetCount() const;
 	juce::String getPresetName(int presetIndex) const;
 	void setPreset(int presetIndex);
 	int getCurrentPreset() const;
+	int getChannelPreset(int midiChannel) const;   // Channel 10 (index 9) plays the drum kit
+	bool isPresetLoaded(int presetIndex) const;     // False while its samples still load
+
+	//==============================================================================
+	// Wavetable support. The wavetable engine plays the sine engine's voices, with the same
+	// tuning and glide, from the current table (a saw until another is set). Tables are built
+	// by the caller off the audio thread, the previous one is freed here.
+	void setWavetable(std::unique_ptr<Wavetable> newWavetable);
+	juce::String getWavetableName() const { return wavetable->getName(); }
+	juce::File getWavetableFile() const { return wavetable->getFile(); }
 
 	//==============================================================================
 	// Audio rendering - override to handle soundfont mode
@@ -59,13 +84,94 @@ public:
 	void setGlobalGain(float gainLinear);
 	float getGlobalGain() const { return globalGain; }
 
+	//==============================================================================
+	// Sine voice polyphony (1 to MAX_SINE_VOICES). All voices are allocated in setup(),
+	// so this may change while playing; voices above a lowered limit are released.
+	static constexpr int MAX_SINE_VOICES = 256;
+	void setMaxPolyphony(int maxVoices);
+	int getMaxPolyphony() const { return maxPolyphony; }
+
+	// Time in which sounding notes of both engines slide to a new tuning (0 to MAX_RETUNE_GLIDE_MS).
+	// New notes always start at their exact pitch. The default of 0 retunes instantly.
+	static constexpr double MAX_RETUNE_GLIDE_MS = 200.0;
+	void setRetuneGlideTime(double milliseconds);
+	double getRetuneGlideTime() const { return retuneGlideMs; }
+	
+	// Samples between the SoundFont engine's envelope/LFO updates (16 to 128, 0 = chosen
+	// from the sample rate). Doesn't allocate, so it may change while playing.
+	void setControlBlockSize(int samples);
+	int getControlBlockSize() const;
+
+protected:
+	//==============================================================================
+	// Voice allocation in O(1): a free voice if there is one, or else the voice that has been
+	// in release the longest, or else the oldest held note. Notes still in their attack are
+	// stolen last, so a chord over the limit doesn't take its own notes.
+	juce::SynthesiserVoice* findFreeVoice(juce::SynthesiserSound* soundToPlay, int midiChannel,
+										  int midiNoteNumber, bool stealIfNoneAvailable) const override;
+	void renderVoices(juce::AudioBuffer<float>& outputBuffer, int startSample, int numSamples) override;
+
 private:
 	//==============================================================================
-	// A simple sine wave voice (original implementation)
-	class FluidJustVoice : public juce::SynthesiserVoice
+	// State of all oscillators in contiguous arrays indexed by voice pool index. The voices only
+	// start and stop their oscillator; the bank renders every active one into a shared mono
+	// buffer in a single pass, with no per-voice calls or scratch buffers.
+	class OscillatorBank
 	{
 	public:
-		FluidJustVoice();
+		static constexpr int RENDER_CHUNK_SIZE = 256;   // Most samples render() takes at once
+
+		void prepare(int numOscillators);
+
+		// Envelope rates are the change of the 0-1 envelope per sample
+		void start(int index, double cyclesPerSample, double level, double attackRate);
+		void release(int index, double releaseRate);
+		void stop(int index);
+		
+		// Moves an oscillator to a new increment over numSamples, linearly in cents (at once if 0)
+		void glideTo(int index, double cyclesPerSample, int numSamples);
+		
+		// Waveform of all oscillators, nullptr for sines. Changed under the synth's lock.
+		void setWavetable(const Wavetable* table) { wavetable = table; }
+
+		// Adds numSamples of all active oscillators to mix. Oscillators whose release ended are
+		// deactivated and their indices written to finished, returns how many.
+		int render(float* mix, int numSamples, int* finished);
+
+	private:
+		std::vector<double> phases;          // Cycles, carried in double precision between chunks
+		std::vector<double> increments;      // Cycles per sample
+		std::vector<double> glideRatios;     // Increment factor per sample while gliding
+		std::vector<double> glideTargets;    // Increment at the end of the glide
+		std::vector<int> glideSamples;       // Samples left to glide, 0 for a steady pitch
+		std::vector<double> levels;
+		std::vector<double> envelopes;       // 0-1
+		std::vector<double> envelopeSteps;   // Per sample: attack > 0, sustain 0, release < 0
+		std::vector<int> activeIndices;      // Dense list of sounding oscillators
+		std::vector<int> activePositions;    // Position of each oscillator in activeIndices, -1 if silent
+		const Wavetable* wavetable = nullptr;
+		
+		// Adds one oscillator to mix and advances its phase and glide. Waveform maps a 32 bit
+		// fixed point phase to a sample.
+		template <typename Waveform>
+		void renderOscillator(size_t index, float* mix, int numSamples, Waveform waveform);
+	};
+
+	//==============================================================================
+	// Voices linked through their pool indices, so the lists never allocate
+	struct VoiceList
+	{
+		int first = -1;
+		int last = -1;
+	};
+
+	//==============================================================================
+	// A voice of the sine and wavetable engines: note bookkeeping for JUCE's Synthesiser,
+	// the sound comes from its oscillator in the bank
+	class FluidJustVoice final : public juce::SynthesiserVoice
+	{
+	public:
+		FluidJustVoice(FluidJustIntonationSynth& owner, int poolIndex);
 
 		bool canPlaySound(juce::SynthesiserSound*) override;
 
@@ -80,19 +186,26 @@ private:
 		// Set a custom frequency for this voice
 		void setCustomFrequency(double freqHz);
 
+		// Called once the oscillator's release has ended
+		void finishNote();
+
+		const int poolIndex;
+		int freeListPosition = -1;   // Index in the synth's free list, -1 while in use
+		
+		// Links in heldVoices or releasingVoices while in use, by pool index
+		VoiceList* list = nullptr;
+		int previousInList = -1;
+		int nextInList = -1;
+
 	private:
-		double level = 0.0;
+		FluidJustIntonationSynth& owner;
+
 		double frequency = 440.0;
 		double customFrequency = 0.0;
-		double phase = 0.0;
-		double tailOff = 0.0;
 
 		// Simple attack/release envelope
 		double attackRate = 0.1;
 		double releaseRate = 0.1;
-		double env = 0.0;
-		bool isAttacking = false;
-		bool isReleasing = false;
 	};
 
 	//==============================================================================
@@ -113,8 +226,8 @@ private:
 	// SoundFont player instance
 	std::unique_ptr<SoundFontPlayer> soundFontPlayer;
 
-	// Map from MIDI note number to actual frequency
-	std::map<int, double> noteToFrequencyMap;
+	// Actual frequency of each MIDI note, 0 until a tuning is set
+	std::array<double, 128> noteToFrequencyMap {};
 
 	// Global gain
 	float globalGain = 1.0f;
@@ -129,5 +242,27 @@ private:
 	// Update all currently playing voices to the new tuning
 	void updatePlayingVoices();
 
+	// Sine voices by pool index, owned by the Synthesiser's voice array, and their oscillators
+	std::vector<FluidJustVoice*> sineVoices;
+	OscillatorBank oscillatorBank;
+	std::vector<int> freeVoiceIndices;   // Stack of idle voices below maxPolyphony, capacity MAX_SINE_VOICES
+	
+	// Voices in use, oldest first: held notes in the order they started and released ones
+	// in the order they were released
+	VoiceList heldVoices;
+	VoiceList releasingVoices;
+	int maxPolyphony = 16;
+	double retuneGlideMs = 0.0;
+	
+	// Table of the wavetable engine, never null
+	std::unique_ptr<Wavetable> wavetable;
+
+	void markVoiceFree(FluidJustVoice& voice);
+	void markVoiceBusy(FluidJustVoice& voice);
+	void markVoiceReleasing(FluidJustVoice& voice);
+	void appendToList(VoiceList& list, FluidJustVoice& voice);
+	void removeFromList(FluidJustVoice& voice);
+	void rebuildFreeVoiceList();
+
 	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(FluidJustIntonationSynth)
 };
\ No newline at end of file
@@ -0,0 +1,125 @@
+#include "Wavetable.h"
+#include <complex>
+
+//==============================================================================
+Wavetable::Wavetable(const juce::String& waveformName, const std::vector<double>& cosines, const std::vector<double>& sines)
+	: name(waveformName),
+	  tables(static_cast<size_t>(NUM_LEVELS * (TABLE_SIZE + 1)), 0.0f)
+{
+	// One cycle of sin(2 pi n / TABLE_SIZE): harmonic k at sample n is entry (k * n) mod TABLE_SIZE
+	std::vector<double> sineCycle(TABLE_SIZE);
+	for (int n = 0; n < TABLE_SIZE; ++n)
+		sineCycle[static_cast<size_t>(n)] = std::sin(juce::MathConstants<double>::twoPi * n / TABLE_SIZE);
+	
+	// The sparsest table first, each fuller one adds the next octave of harmonics to the one before
+	std::vector<double> cycle(TABLE_SIZE, 0.0);
+	int harmonicsDone = 0;
+	
+	for (int level = NUM_LEVELS; --level >= 0;)
+	{
+		const int numHarmonics = MAX_HARMONIC >> level;
+		
+		for (int k = harmonicsDone + 1; k <= numHarmonics; ++k)
+		{
+			const double cosine = cosines[static_cast<size_t>(k - 1)];
+			const double sine = sines[static_cast<size_t>(k - 1)];
+			
+			if (cosine == 0.0 && sine == 0.0)
+				continue;
+			
+			for (int n = 0; n < TABLE_SIZE; ++n)
+			{
+				const int index = (k * n) & (TABLE_SIZE - 1);
+				cycle[static_cast<size_t>(n)] += cosine * sineCycle[static_cast<size_t>((index + TABLE_SIZE / 4) & (TABLE_SIZE - 1))]
+											   + sine * sineCycle[static_cast<size_t>(index)];
+			}
+		}
+		
+		harmonicsDone = numHarmonics;
+		
+		float* table = tables.data() + level * (TABLE_SIZE + 1);
+		for (int n = 0; n < TABLE_SIZE; ++n)
+			table[n] = static_cast<float>(cycle[static_cast<size_t>(n)]);
+		table[TABLE_SIZE] = table[0];
+	}
+	
+	// One scale for all tables, so the fullest peaks at 1 and a note keeps its level across octaves
+	const auto range = juce::FloatVectorOperations::findMinAndMax(tables.data(), TABLE_SIZE);
+	const float peak = juce::jmax(std::abs(range.getStart()), std::abs(range.getEnd()));
+	
+	if (peak > 0.0f)
+		juce::FloatVectorOperations::multiply(tables.data(), 1.0f / peak, static_cast<int>(tables.size()));
+}
+
+std::unique_ptr<Wavetable> Wavetable::createSaw()
+{
+	// Rising ramp: sine harmonics of amplitude 1 / k with alternating sign
+	std::vector<double> cosines(MAX_HARMONIC, 0.0), sines(MAX_HARMONIC, 0.0);
+	for (int k = 1; k <= MAX_HARMONIC; ++k)
+		sines[static_cast<size_t>(k - 1)] = (k % 2 != 0 ? 1.0 : -1.0) / k;
+	
+	return std::unique_ptr<Wavetable>(new Wavetable("Saw", cosines, sines));
+}
+
+std::unique_ptr<Wavetable> Wavetable::createSquare()
+{
+	// Odd sine harmonics of amplitude 1 / k
+	std::vector<double> cosines(MAX_HARMONIC, 0.0), sines(MAX_HARMONIC, 0.0);
+	for (int k = 1; k <= MAX_HARMONIC; k += 2)
+		sines[static_cast<size_t>(k - 1)] = 1.0 / k;
+	
+	return std::unique_ptr<Wavetable>(new Wavetable("Square", cosines, sines));
+}
+
+std::unique_ptr<Wavetable> Wavetable::createFromFile(const juce::File& sourceFile)
+{
+	juce::AudioFormatManager formatManager;
+	formatManager.registerBasicFormats();
+	
+	std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(sourceFile));
+	
+	if (reader == nullptr || reader->lengthInSamples <= 1 || reader->lengthInSamples > MAX_IMPORT_SAMPLES)
+		return nullptr;
+	
+	const int length = static_cast<int>(reader->lengthInSamples);
+	std::vector<float> samples(static_cast<size_t>(length));
+	float* channels[] = { samples.data() };
+	
+	if (!reader->read(channels, 1, 0, length))
+		return nullptr;
+	
+	// Harmonic amplitudes of the cycle by direct DFT, which handles any cycle length. The phasor of
+	// each harmonic is stepped by complex multiplication instead of calling sin and cos per sample.
+	const int numHarmonics = juce::jmin(MAX_HARMONIC, (length - 1) / 2);
+	std::vector<double> cosines(MAX_HARMONIC, 0.0), sines(MAX_HARMONIC, 0.0);
+	
+	for (int k = 1; k <= numHarmonics; ++k)
+	{
+		const double step = juce::MathConstants<double>::twoPi * k / length;
+		const std::complex<double> rotation(std::cos(step), std::sin(step));
+		std::complex<double> phasor(1.0, 0.0), sum(0.0, 0.0);
+		
+		for (int n = 0; n < length; ++n)
+		{
+			sum += static_cast<double>(samples[static_cast<size_t>(n)]) * phasor;
+			phasor *= rotation;
+		}
+		
+		cosines[static_cast<size_t>(k - 1)] = 2.0 * sum.real() / length;
+		sines[static_cast<size_t>(k - 1)] = 2.0 * sum.imag() / length;
+	}
+	
+	std::unique_ptr<Wavetable> wavetable(new Wavetable(sourceFile.getFileNameWithoutExtension(), cosines, sines));
+	wavetable->file = sourceFile;
+	return wavetable;
+}
+
+//==============================================================================
+const float* Wavetable::getTable(double cyclesPerSample) const
+{
+	int level = 0;
+	while (level < NUM_LEVELS - 1 && (MAX_HARMONIC >> level) * cyclesPerSample > 0.5)
+		++level;
+	
+	return tables.data() + level * (TABLE_SIZE + 1);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <memory>
+#include <vector>
+
+//==============================================================================
+/**
+ * Wavetable - A band-limited single-cycle waveform for the wavetable engine
+ *
+ * The cycle is stored once per octave of playback rate, each copy holding only the
+ * harmonics that stay below Nyquist for every rate in its octave, so no note aliases
+ * however high it is tuned. All tables are built when the waveform is created.
+ */
+class Wavetable
+{
+public:
+	//==============================================================================
+	static constexpr int TABLE_BITS = 11;
+	static constexpr int TABLE_SIZE = 1 << TABLE_BITS;   // Samples per cycle
+	static constexpr int MAX_HARMONIC = TABLE_SIZE / 2;  // Harmonics in the fullest table
+	static constexpr int NUM_LEVELS = TABLE_BITS;        // Table n holds harmonics up to MAX_HARMONIC >> n
+	static constexpr int MAX_IMPORT_SAMPLES = 1 << 14;   // Longest single cycle read from a file
+
+	//==============================================================================
+	static std::unique_ptr<Wavetable> createSaw();
+	static std::unique_ptr<Wavetable> createSquare();
+
+	// Reads the first channel of an audio file as one cycle of any length. Returns nullptr
+	// if the file can't be read, is empty or longer than MAX_IMPORT_SAMPLES.
+	static std::unique_ptr<Wavetable> createFromFile(const juce::File& file);
+
+	const juce::String& getName() const { return name; }
+	const juce::File& getFile() const { return file; }
+
+	//==============================================================================
+	// The table with the most harmonics that stay below Nyquist when played at this rate.
+	// Tables have TABLE_SIZE + 1 samples, the last repeats the first for interpolation.
+	const float* getTable(double cyclesPerSample) const;
+
+	// Linearly interpolated value at a 32 bit fixed point fraction of a cycle
+	static float lookup(const float* table, juce::uint32 phase)
+	{
+		constexpr int fractionBits = 32 - TABLE_BITS;
+		const auto index = phase >> fractionBits;
+		const float alpha = static_cast<float>(phase & ((1u << fractionBits) - 1)) * (1.0f / static_cast<float>(1u << fractionBits));
+		return table[index] + alpha * (table[index + 1] - table[index]);
+	}
+
+private:
+	//==============================================================================
+	// Builds every table from the cosine and sine amplitudes of harmonics 1 to MAX_HARMONIC
+	Wavetable(const juce::String& name, const std::vector<double>& cosines, const std::vector<double>& sines);
+
+	juce::String name;
+	juce::File file;
+	std::vector<float> tables;   // NUM_LEVELS tables of TABLE_SIZE + 1 samples, fullest first
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(Wavetable)
+};
@@ -89,9 +89,125 @@ struct tsf_stream
 // Generic SoundFont loading method using the stream structure above
 TSFDEF tsf* tsf_load(struct tsf_stream* stream);
 
+// One compressed (SF3) sample to be decoded by a tsf_sample_decoder
+struct tsf_decode_job
+{
+	const void* compressed; // the sample's Ogg Vorbis stream
+	unsigned int size;      // bytes in compressed
+	float* out;             // receives exactly 'length' mono samples (-1 to 1)
+	unsigned int length;    // as returned by get_length
+};
+
+// Decoder for compressed (SF3) samples provided by the application, so no built-in Vorbis decoder is needed
+struct tsf_sample_decoder
+{
+	// Custom data given to the functions as the first parameter
+	void* data;
+
+	// Function pointer will be called to get the number of samples in a compressed sample (returns 0 if it can't be decoded, it then stays silent)
+	unsigned int (*get_length)(void* data, const void* compressed, unsigned int size);
+
+	// Function pointer will be called with compressed samples of the SoundFont, all at once from tsf_load_with_decoder
+	// or a few per tsf_load_deferred_step, which it may decode in parallel before returning (returns 1 on success, 0 to fail)
+	int (*decode)(void* data, struct tsf_decode_job* jobs, int count);
+};
+
+// Load a SoundFont which may contain compressed (SF3) samples, decoding them with the given decoder.
+// Uncompressed SoundFonts load the same as with tsf_load.
+TSFDEF tsf* tsf_load_with_decoder(struct tsf_stream* stream, const struct tsf_sample_decoder* decoder);
+
+// Random access to a SoundFont file for disk streaming
+struct tsf_stream_source
+{
+	// Custom data given to the function as the first parameter
+	void* data;
+
+	// Function pointer will be called to read 'size' bytes at byte 'offset' of the file into ptr (returns number of read bytes)
+	// It is called from tsf_load_streamed and tsf_stream_service only, never from the render functions.
+	int (*read_at)(void* data, void* ptr, unsigned int offset, unsigned int size);
+};
+
+// Load a SoundFont for disk streaming (DFD). Only the first preload_seconds of each sample are
+// kept in memory, the rest is read while playing by tsf_stream_service.
+//   stream: reader for the SoundFont, read once from the start during loading
+//   source: random access reader for the same file which must stay valid until tsf_close
+//   preload_seconds: length of each sample to keep resident, covers the time until the stream catches up
+// Looped samples whose loop can't be held in a voice's stream buffer stay fully resident.
+// Compressed (SF3) SoundFonts can't be streamed and return NULL.
+TSFDEF tsf* tsf_load_streamed(struct tsf_stream* stream, const struct tsf_stream_source* source, float preload_seconds);
+
+// Read ahead the streamed samples of all playing voices. Call this regularly (every few milliseconds)
+// from a background thread. Returns the number of voices that are currently streaming.
+// Requires voices to be pre-allocated with tsf_set_max_voices, which must not be called concurrently.
+TSFDEF int tsf_stream_service(tsf* f);
+
+// Number of render blocks in which a streaming voice ran out of data (rendered as silence)
+TSFDEF unsigned int tsf_stream_get_underruns(const tsf* f);
+
+// Load only the presets and regions of a SoundFont, its sample data is read afterwards with
+// tsf_load_deferred_step. Preset names and banks are available right away, notes of presets whose
+// samples aren't in memory yet are skipped (see tsf_preset_is_loaded).
+//   stream: reader for the SoundFont, read once from the start
+//   source: random access reader for the same file which must stay valid until loading is complete
+// Compressed (SF3) SoundFonts return NULL, they're loaded with tsf_load_deferred_with_decoder.
+TSFDEF tsf* tsf_load_deferred(struct tsf_stream* stream, const struct tsf_stream_source* source);
+
+// Load only the presets and regions of a SoundFont which may contain compressed (SF3) samples, like
+// tsf_load_deferred. The sample chunk is kept in memory and decoded by tsf_load_deferred_step, which calls
+// the decoder's decode function. Only get_length is called while loading. The decoder's data must stay
+// valid until loading is complete.
+TSFDEF tsf* tsf_load_deferred_with_decoder(struct tsf_stream* stream, const struct tsf_sample_decoder* decoder);
+
+// Read and convert (or decode) up to max_samples more sample data of a SoundFont from tsf_load_deferred
+// or tsf_load_deferred_with_decoder, at least one compressed sample is decoded per call.
+// This may run on a background thread while rendering. Returns 1 while more data remains to
+// be read, 0 once all samples are in memory, or -1 if reading or decoding failed (the call can be retried).
+TSFDEF int tsf_load_deferred_step(tsf* f, int max_samples);
+
+// Returns 1 if all samples used by a preset are in memory and it plays completely, otherwise 0
+TSFDEF int tsf_preset_is_loaded(const tsf* f, int preset_index);
+
+// Build octave-decimated, band-limited copies of the sample data. Voices pitched well above
+// their root key then read the copy with the playback rate closest to 1, which avoids aliasing
+// from skipped samples and keeps the reads close together in memory. Each sample is decimated on
+// its own, with its loop repeated so the filter sees the loop's start after its end.
+//   levels: number of octaves to build (up to TSF_MIPMAP_MAXLEVELS), takes up to twice the sample memory for looped samples
+// This may run on a background thread while rendering, voices pick up the tables once they are done.
+// The tables are built once and shared with copies, so call this before tsf_copy (returns 0 if
+// the instance was copied before building, its samples are still loading or allocation failed, otherwise 1). Samples streamed from disk always play at full rate.
+TSFDEF int tsf_build_mipmaps(tsf* f, int levels);
+
+// A loaded SoundFont can be saved as a cache image holding its preset, region and sample tables
+// in the layout tsf uses while playing, so loading it again needs no parsing or sample conversion.
+// The image is specific to the tsf version and platform that wrote it, tsf_load_cache rejects others.
+// Returns the size of the cache image in bytes, or 0 if the SoundFont can't be cached (streamed from disk, still loading or over 4 GB)
+TSFDEF unsigned int tsf_cache_size(const tsf* f);
+
+// Output structure for tsf_cache_write
+struct tsf_cache_writer
+{
+	// Custom data given to the function as the first parameter
+	void* data;
+
+	// Function pointer will be called to write 'size' bytes from ptr (returns 1 on success, 0 to stop writing)
+	int (*write)(void* data, const void* ptr, unsigned int size);
+};
+
+// Write the cache image of tsf_cache_size bytes to writer, in order: header, presets, regions, then
+// the samples in chunks. Needs no buffer for the whole image, and stops at the first write that returns 0.
+// (returns 0 if it can't be cached or a write failed, otherwise 1)
+TSFDEF int tsf_cache_write(const tsf* f, const struct tsf_cache_writer* writer);
+
+// Create a tsf instance from a cache image, using its regions and samples in place (e.g. from a memory mapped file)
+//   buffer: the cache image, 16 byte aligned, which must stay valid and unchanged until tsf_close
+//   size: number of bytes in buffer
+// Returns NULL if the image is invalid or was written by a different tsf version or platform.
+TSFDEF tsf* tsf_load_cache(const void* buffer, unsigned int size);
+
 // Copy a tsf instance from an existing one, use tsf_close to close it as well.
 // All copied tsf instances and their original instance are linked, and share the underlying soundfont.
 // This allows loading a soundfont only once, but using it for multiple independent playbacks.
+// Returns NULL while the samples of a two-phase load are still loading.
 // (This function isn't thread-safe without locking.)
 TSFDEF tsf* tsf_copy(tsf* f);
 
@@ -110,6 +226,9 @@ TSFDEF int tsf_get_presetcount(const tsf* f);
 // Returns the name of a preset index >= 0 and < tsf_get_presetcount()
 TSFDEF const char* tsf_get_presetname(const tsf* f, int preset_index);
 
+// Returns the bank of a preset index >= 0 and < tsf_get_presetcount() (128 for percussion)
+TSFDEF int tsf_get_presetbank(const tsf* f, int preset_index);
+
 // Returns the name of a preset by bank and preset number
 TSFDEF const char* tsf_bank_get_presetname(const tsf* f, int bank, int preset_number);
 
@@ -145,7 +264,8 @@ enum TSFOutputMode
 // Calls to tsf_channel_set_... functions may allocate new channels
 // if no channel with that number was previously used. Make sure to
 // create all channels at the beginning as required if you call tsf_render*
-// from a different thread.
+// from a different thread, for example with tsf_set_max_channels.
+// tsf_reset keeps the allocated channels and only resets their parameters.
 
 // Setup the parameters for the voice render methods
 //   outputmode: if mono or stereo and how stereo channel data is ordered
@@ -157,6 +277,12 @@ TSFDEF void tsf_set_output(tsf* f, enum TSFOutputMode outputmode, int samplerate
 //   global_gain: the desired volume where 1.0 is 100%
 TSFDEF void tsf_set_volume(tsf* f, float global_gain);
 
+// Set how often envelopes, LFOs and the lowpass filter are updated
+//   block_samples: samples between updates, 1 to TSF_RENDER_MAXEFFECTSAMPLEBLOCK (default TSF_RENDER_EFFECTSAMPLEBLOCK)
+// Gain and pitch are interpolated linearly within each block, so larger blocks
+// mostly trade modulation accuracy for lower CPU usage.
+TSFDEF void tsf_set_effect_block(tsf* f, int block_samples);
+
 // Set the maximum number of voices to play simultaneously
 // Depending on the soundfond, one note can cause many new voices to be started,
 // so don't keep this number too low or otherwise sounds may not play.
@@ -164,6 +290,11 @@ TSFDEF void tsf_set_volume(tsf* f, float global_gain);
 //   (tsf_set_max_voices returns 0 if allocation failed, otherwise 1)
 TSFDEF int tsf_set_max_voices(tsf* f, int max_voices);
 
+// Pre-allocate channels so the tsf_channel_* functions don't allocate on first use
+//   channel_count: channels 0 to channel_count - 1 are created (higher channels are still allocated when used)
+//   (tsf_set_max_channels returns 0 if allocation failed, otherwise 1)
+TSFDEF int tsf_set_max_channels(tsf* f, int channel_count);
+
 // Start playing a note
 //   preset_index: preset index >= 0 and < tsf_get_presetcount()
 //   key: note value between 0 and 127 (60 being middle C)
@@ -206,7 +337,11 @@ TSFDEF void tsf_render_float(tsf* f, float* buffer, int samples, int flag_mixing
 //   pitch_wheel: pitch wheel position 0 to 16383 (default 8192 unpitched)
 //   pitch_range: range of the pitch wheel in semitones (default 2.0, total +/- 2 semitones)
 //   tuning: tuning of all playing voices in semitones (default 0.0, standard (A440) tuning)
+//   glide_seconds: time over which playing voices slide to the pitch set by later pitch wheel, pitch range
+//                  or tuning changes, linearly in cents (default 0.0, changes apply at once)
 //   flag_sustain: 0 to end notes that were held sustained and disable holding sustain otherwise enable it
+//   mod_wheel: modulation wheel position 0 to 16383 (default 0, adds up to 50 cents of vibrato depth)
+//   pressure: channel pressure 0 to 127 (default 0, adds up to 50 cents of vibrato depth)
 //   (tsf_set_preset_number and set_bank_preset return 0 if preset does not exist, otherwise 1)
 //   (tsf_channel_set_... return 0 if a new channel needed allocation and that failed, otherwise 1)
 TSFDEF int tsf_channel_set_presetindex(tsf* f, int channel, int preset_index);
@@ -218,7 +353,10 @@ TSFDEF int tsf_channel_set_volume(tsf* f, int channel, float volume);
 TSFDEF int tsf_channel_set_pitchwheel(tsf* f, int channel, int pitch_wheel);
 TSFDEF int tsf_channel_set_pitchrange(tsf* f, int channel, float pitch_range);
 TSFDEF int tsf_channel_set_tuning(tsf* f, int channel, float tuning);
+TSFDEF int tsf_channel_set_pitchglide(tsf* f, int channel, float glide_seconds);
 TSFDEF int tsf_channel_set_sustain(tsf* f, int channel, int flag_sustain);
+TSFDEF int tsf_channel_set_modwheel(tsf* f, int channel, int mod_wheel);
+TSFDEF int tsf_channel_set_pressure(tsf* f, int channel, int pressure);
 
 // Start or stop playing notes on a channel (needs channel preset to be set)
 //   channel: channel number
@@ -259,14 +397,18 @@ TSFDEF float tsf_channel_get_tuning(tsf* f, int channel);
 // The lower this block size is the more accurate the effects are.
 // Increasing the value significantly lowers the CPU usage of the voice rendering.
 // If LFO affects the low-pass filter it can be hearable even as low as 8.
+// This is the default, tsf_set_effect_block changes it at runtime up to TSF_RENDER_MAXEFFECTSAMPLEBLOCK.
 #ifndef TSF_RENDER_EFFECTSAMPLEBLOCK
 #define TSF_RENDER_EFFECTSAMPLEBLOCK 64
 #endif
+#ifndef TSF_RENDER_MAXEFFECTSAMPLEBLOCK
+#define TSF_RENDER_MAXEFFECTSAMPLEBLOCK 128
+#endif
 
 // When using tsf_render_short, to do the conversion a buffer of a fixed size is
 // allocated on the stack. On low memory platforms this could be made smaller.
 // Increasing this above 512 should not have a significant impact on performance.
-// The value should be a multiple of TSF_RENDER_EFFECTSAMPLEBLOCK.
+// The value should be a multiple of TSF_RENDER_MAXEFFECTSAMPLEBLOCK.
 #ifndef TSF_RENDER_SHORTBUFFERBLOCK
 #define TSF_RENDER_SHORTBUFFERBLOCK 512
 #endif
@@ -274,6 +416,37 @@ TSFDEF float tsf_channel_get_tuning(tsf* f, int channel);
 // Grace release time for quick voice off (avoid clicking noise)
 #define TSF_FASTRELEASETIME 0.01f
 
+// Lowpass filter coefficients come from a per-instance table of tan(pi * Fc / samplerate)
+// indexed by cutoff in cents (interpolated between entries), rebuilt when the sample rate changes.
+// Filtered voices are run through the filter in groups of TSF_LOWPASS_LANES.
+#define TSF_LOWPASS_CENTSSTEP 10
+#define TSF_LOWPASS_MAXCENTS 13500
+#define TSF_LOWPASS_TABLESIZE (TSF_LOWPASS_MAXCENTS / TSF_LOWPASS_CENTSSTEP + 1)
+#define TSF_LOWPASS_LANES 4
+
+// Per-voice ring buffer for disk streaming in samples (must be a power of two).
+// Loops longer than half of this keep their sample fully resident.
+#ifndef TSF_STREAM_RINGSAMPLES
+#define TSF_STREAM_RINGSAMPLES 32768
+#endif
+#define TSF_STREAM_READSAMPLES 4096
+
+// Maximum number of octave-decimated sample tables built by tsf_build_mipmaps.
+// Each level is made from the one above it with a TSF_MIPMAP_TAPS * 4 - 1 tap half-band filter.
+#ifndef TSF_MIPMAP_MAXLEVELS
+#define TSF_MIPMAP_MAXLEVELS 4
+#endif
+#define TSF_MIPMAP_TAPS 8
+
+// Samples read by regions with the same offset, end and loop, decimated apart from the other samples.
+// The tables hold the samples from 'base' on, then the loop once more and the filter's reach.
+struct tsf_mipspan
+{
+	unsigned int offset, end, loopStart, loopEnd, residentShift; // as in the regions, loopStart == loopEnd if they don't loop
+	unsigned int base; // first sample index in the tables, the loop start if it comes before the offset
+	unsigned int start[TSF_MIPMAP_MAXLEVELS]; // index of the span in the table of each level
+};
+
 #if !defined(TSF_MALLOC) || !defined(TSF_FREE) || !defined(TSF_REALLOC)
 #  include <stdlib.h>
 #  define TSF_MALLOC  malloc
@@ -307,6 +480,30 @@ TSFDEF float tsf_channel_get_tuning(tsf* f, int channel);
 #  include <stdio.h>
 #endif
 
+// Orders the handover of streamed sample data between tsf_stream_service and the render thread
+#ifndef TSF_MEMORY_BARRIER
+#  if defined(__GNUC__) || defined(__clang__)
+#    define TSF_MEMORY_BARRIER() __sync_synchronize()
+#  elif defined(_MSC_VER) && defined(_M_ARM64)
+#    include <intrin.h>
+#    define TSF_MEMORY_BARRIER() __dmb(_ARM64_BARRIER_ISH)
+#  elif defined(_MSC_VER)
+#    include <intrin.h>
+#    define TSF_MEMORY_BARRIER() _ReadWriteBarrier()
+#  else
+#    define TSF_MEMORY_BARRIER()
+#  endif
+#endif
+
+// Define TSF_NO_SIMD to use the plain C lowpass filter on all platforms
+#if !defined(TSF_NO_SIMD) && (defined(__SSE__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+#  include <xmmintrin.h>
+#  define TSF_SIMD_SSE
+#elif !defined(TSF_NO_SIMD) && (defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64))
+#  include <arm_neon.h>
+#  define TSF_SIMD_NEON
+#endif
+
 #define TSF_TRUE 1
 #define TSF_FALSE 0
 #define TSF_BOOL unsigned char
@@ -323,14 +520,19 @@ typedef unsigned char tsf_u8;
 typedef unsigned short tsf_u16;
 typedef signed short tsf_s16;
 typedef unsigned int tsf_u32;
+typedef unsigned long long tsf_u64;
+typedef signed long long tsf_s64;
 typedef char tsf_char20[20];
 
 #define TSF_FourCCEquals(value1, value2) (value1[0] == value2[0] && value1[1] == value2[1] && value1[2] == value2[2] && value1[3] == value2[3])
 
 struct tsf
 {
+	struct tsf_arena_block* arena; // holds the presets and their regions
 	struct tsf_preset* presets;
 	float* fontSamples;
+	unsigned int fontSampleNum;
+	TSF_BOOL fontExternal; // regions and samples are used in place from a cache image
 	struct tsf_voice* voices;
 	struct tsf_channels* channels;
 
@@ -342,7 +544,26 @@ struct tsf
 	enum TSFOutputMode outputmode;
 	float outSampleRate;
 	float globalGainDB;
+	int effectBlockSamples;
 	int* refCount;
+
+	float* lowpassTable;
+	float lowpassTableSampleRate, lowpassMaxCents;
+
+	struct tsf_stream_source streamSource;
+	tsf_u32 streamSmplOffset, streamSmplCount;
+	float* streamRings;
+	volatile unsigned int streamUnderruns;
+
+	float* mipSamples[TSF_MIPMAP_MAXLEVELS]; // level 1 (half rate) and up, valid below mipLevels
+	struct tsf_mipspan* mipSpans; // sorted, valid when mipLevels is set
+	int mipSpanNum;
+	volatile int mipLevels;
+
+	struct tsf_stream_source deferredSource; // set for two-phase loading, fontSamples below fontSamplesLoaded are valid
+	tsf_u32 deferredSmplOffset;
+	struct tsf_deferred_decode* deferredDecode; // set instead of deferredSource when compressed samples are decoded in the second phase
+	volatile unsigned int fontSamplesLoaded;
 };
 
 #ifndef TSF_NO_STDIO
@@ -386,6 +607,35 @@ enum { TSF_LOOPMODE_NONE, TSF_LOOPMODE_CONTINUOUS, TSF_LOOPMODE_SUSTAIN };
 
 enum { TSF_SEGMENT_NONE, TSF_SEGMENT_DELAY, TSF_SEGMENT_ATTACK, TSF_SEGMENT_HOLD, TSF_SEGMENT_DECAY, TSF_SEGMENT_SUSTAIN, TSF_SEGMENT_RELEASE, TSF_SEGMENT_DONE };
 
+// Bump allocator for data that lives and dies together. Allocations are carved from blocks
+// of at least the size hinted by the first allocation, the whole chain is freed at once.
+#define TSF_ARENA_ALIGN 16
+struct tsf_arena_block { struct tsf_arena_block* next; unsigned int size, used; };
+
+static void* tsf_arena_alloc(struct tsf_arena_block** arena, unsigned int size, unsigned int blockSizeHint)
+{
+	struct tsf_arena_block* block = *arena;
+	unsigned int header = (sizeof(struct tsf_arena_block) + TSF_ARENA_ALIGN - 1) & ~(TSF_ARENA_ALIGN - 1);
+	size = (size + TSF_ARENA_ALIGN - 1) & ~(TSF_ARENA_ALIGN - 1);
+	if (!block || block->size - block->used < size)
+	{
+		unsigned int blockSize = (size > blockSizeHint ? size : blockSizeHint);
+		block = (struct tsf_arena_block*)TSF_MALLOC(header + blockSize);
+		if (!block) return TSF_NULL;
+		block->next = *arena;
+		block->size = blockSize;
+		block->used = 0;
+		*arena = block;
+	}
+	block->used += size;
+	return (char*)block + header + block->used - size;
+}
+
+static void tsf_arena_free(struct tsf_arena_block* arena)
+{
+	while (arena) { struct tsf_arena_block* next = arena->next; TSF_FREE(arena); arena = next; }
+}
+
 struct tsf_hydra
 {
 	struct tsf_hydra_phdr *phdrs; struct tsf_hydra_pbag *pbags; struct tsf_hydra_pmod *pmods;
@@ -405,22 +655,24 @@ struct tsf_hydra_imod { tsf_u16 modSrcOper, modDestOper; tsf_s16 modAmount; tsf_
 struct tsf_hydra_igen { tsf_u16 genOper; union tsf_hydra_genamount genAmount; };
 struct tsf_hydra_shdr { tsf_char20 sampleName; tsf_u32 start, end, startLoop, endLoop, sampleRate; tsf_u8 originalPitch; tsf_s8 pitchCorrection; tsf_u16 sampleLink, sampleType; };
 
-#define TSFR(FIELD) stream->read(stream->data, &i->FIELD, sizeof(i->FIELD));
-static void tsf_hydra_read_phdr(struct tsf_hydra_phdr* i, struct tsf_stream* stream) { TSFR(presetName) TSFR(preset) TSFR(bank) TSFR(presetBagNdx) TSFR(library) TSFR(genre) TSFR(morphology) }
-static void tsf_hydra_read_pbag(struct tsf_hydra_pbag* i, struct tsf_stream* stream) { TSFR(genNdx) TSFR(modNdx) }
-static void tsf_hydra_read_pmod(struct tsf_hydra_pmod* i, struct tsf_stream* stream) { TSFR(modSrcOper) TSFR(modDestOper) TSFR(modAmount) TSFR(modAmtSrcOper) TSFR(modTransOper) }
-static void tsf_hydra_read_pgen(struct tsf_hydra_pgen* i, struct tsf_stream* stream) { TSFR(genOper) TSFR(genAmount) }
-static void tsf_hydra_read_inst(struct tsf_hydra_inst* i, struct tsf_stream* stream) { TSFR(instName) TSFR(instBagNdx) }
-static void tsf_hydra_read_ibag(struct tsf_hydra_ibag* i, struct tsf_stream* stream) { TSFR(instGenNdx) TSFR(instModNdx) }
-static void tsf_hydra_read_imod(struct tsf_hydra_imod* i, struct tsf_stream* stream) { TSFR(modSrcOper) TSFR(modDestOper) TSFR(modAmount) TSFR(modAmtSrcOper) TSFR(modTransOper) }
-static void tsf_hydra_read_igen(struct tsf_hydra_igen* i, struct tsf_stream* stream) { TSFR(genOper) TSFR(genAmount) }
-static void tsf_hydra_read_shdr(struct tsf_hydra_shdr* i, struct tsf_stream* stream) { TSFR(sampleName) TSFR(start) TSFR(end) TSFR(startLoop) TSFR(endLoop) TSFR(sampleRate) TSFR(originalPitch) TSFR(pitchCorrection) TSFR(sampleLink) TSFR(sampleType) }
+// Hydra records are decoded from a chunk read in one go, each field copied from its packed position
+// in the file record (fixed size copies that compile to plain loads).
+#define TSFR(FIELD) TSF_MEMCPY(&i->FIELD, p, sizeof(i->FIELD)); p += sizeof(i->FIELD);
+static void tsf_hydra_read_phdr(struct tsf_hydra_phdr* i, const tsf_u8* p) { TSFR(presetName) TSFR(preset) TSFR(bank) TSFR(presetBagNdx) TSFR(library) TSFR(genre) TSFR(morphology) }
+static void tsf_hydra_read_pbag(struct tsf_hydra_pbag* i, const tsf_u8* p) { TSFR(genNdx) TSFR(modNdx) }
+static void tsf_hydra_read_pmod(struct tsf_hydra_pmod* i, const tsf_u8* p) { TSFR(modSrcOper) TSFR(modDestOper) TSFR(modAmount) TSFR(modAmtSrcOper) TSFR(modTransOper) }
+static void tsf_hydra_read_pgen(struct tsf_hydra_pgen* i, const tsf_u8* p) { TSFR(genOper) TSFR(genAmount) }
+static void tsf_hydra_read_inst(struct tsf_hydra_inst* i, const tsf_u8* p) { TSFR(instName) TSFR(instBagNdx) }
+static void tsf_hydra_read_ibag(struct tsf_hydra_ibag* i, const tsf_u8* p) { TSFR(instGenNdx) TSFR(instModNdx) }
+static void tsf_hydra_read_imod(struct tsf_hydra_imod* i, const tsf_u8* p) { TSFR(modSrcOper) TSFR(modDestOper) TSFR(modAmount) TSFR(modAmtSrcOper) TSFR(modTransOper) }
+static void tsf_hydra_read_igen(struct tsf_hydra_igen* i, const tsf_u8* p) { TSFR(genOper) TSFR(genAmount) }
+static void tsf_hydra_read_shdr(struct tsf_hydra_shdr* i, const tsf_u8* p) { TSFR(sampleName) TSFR(start) TSFR(end) TSFR(startLoop) TSFR(endLoop) TSFR(sampleRate) TSFR(originalPitch) TSFR(pitchCorrection) TSFR(sampleLink) TSFR(sampleType) }
 #undef TSFR
 
 struct tsf_riffchunk { tsf_fourcc id; tsf_u32 size; };
 struct tsf_envelope { float delay, attack, hold, decay, sustain, release, keynumToHold, keynumToDecay; };
 struct tsf_voice_envelope { unsigned char segment, segmentIsExponential : 1, isAmpEnv : 1; short midiVelocity; float level, slope; int samplesUntilNextSegment; struct tsf_envelope parameters; };
-struct tsf_voice_lowpass { double QInv, a0, a1, b1, b2, z1, z2; TSF_BOOL active; };
+struct tsf_voice_lowpass { float QInv, a0, a1, b1, b2, z1, z2; TSF_BOOL active; };
 struct tsf_voice_lfo { int samplesUntil; float level, delta; };
 
 struct tsf_region
@@ -438,6 +690,8 @@ struct tsf_region
 	int freqModLFO, modLfoToPitch;
 	float delayVibLFO;
 	int freqVibLFO, vibLfoToPitch;
+	int sampleIndex;
+	unsigned int streamStart, residentShift; // first sample index read from the disk stream (0 if all resident), sample index to resident index offset
 };
 
 struct tsf_preset
@@ -453,9 +707,15 @@ struct tsf_voice
 	int playingPreset, playingKey, playingChannel, heldSustain;
 	struct tsf_region* region;
 	double pitchInputTimecents, pitchOutputFactor;
-	double sourceSamplePosition;
+	double glideTimecents; int glideSamples; // pitch offset still to glide out, linearly over glideSamples
+	tsf_u64 sourceSamplePosition; // 32.32 fixed point sample index
 	float  noteGainDB, panFactorLeft, panFactorRight;
+	float  vibratoDepth;
+	float  controlGain; double controlPitchRatio; TSF_BOOL controlValid;
 	unsigned int playIndex, loopStart, loopEnd;
+	int mipLevel, mipSpan; // mipSpan is -1 if the region has none, -2 before it is looked up
+	TSF_BOOL loopWrapped;
+	float* streamRing; volatile unsigned int streamRequest, streamServed, streamEnd, streamReadPos;
 	struct tsf_voice_envelope ampenv, modenv;
 	struct tsf_voice_lowpass lowpass;
 	struct tsf_voice_lfo modlfo, viblfo;
@@ -463,8 +723,8 @@ struct tsf_voice
 
 struct tsf_channel
 {
-	unsigned short presetIndex, bank, pitchWheel, midiPan, midiVolume, midiExpression, midiRPN, midiData : 14, sustain : 1;
-	float panOffset, gainDB, pitchRange, tuning;
+	unsigned short presetIndex, bank, pitchWheel, midiPan, midiVolume, midiExpression, midiModWheel, midiPressure, midiRPN, midiData : 14, sustain : 1;
+	float panOffset, gainDB, pitchRange, tuning, vibratoDepth, pitchGlide;
 };
 
 struct tsf_channels
@@ -474,10 +734,54 @@ struct tsf_channels
 	struct tsf_channel channels[1];
 };
 
+// Pitch ratios and gains computed every effect block use a polynomial exp2 instead of pow/powf.
+// The relative error is below 2e-7 for pitch ratios (0.0003 cents) and 1e-6 for gains (0.00001 dB).
+// Define TSF_NO_FAST_EXP2 to use the math library functions instead.
+#ifndef TSF_NO_FAST_EXP2
+// 2^x as 2^i * 2^f with i the nearest integer and f in [-0.5, 0.5]. 2^f is the Taylor series of
+// e^(f ln2) up to the 6th power, the first dropped term bounds the relative error to 1.7e-7.
+// The float version is limited by the rounding of its argument to about 1e-6.
+static double tsf_exp2(double x)
+{
+	double f, p, scale;
+	tsf_u64 bits;
+	int i;
+	if (x < -1000.0) x = -1000.0;
+	else if (x > 1000.0) x = 1000.0;
+	i = (int)(x + 0.5);
+	if ((double)i > x + 0.5) i--;
+	f = (x - i) * 0.69314718055994531;
+	p = 1.0 + f * (1.0 + f * (1.0 / 2 + f * (1.0 / 6 + f * (1.0 / 24 + f * (1.0 / 120 + f * (1.0 / 720))))));
+	bits = (tsf_u64)(i + 1023) << 52;
+	TSF_MEMCPY(&scale, &bits, sizeof(scale));
+	return p * scale;
+}
+static float tsf_exp2f(float x)
+{
+	float f, p, scale;
+	tsf_u32 bits;
+	int i;
+	if (x < -126.0f) x = -126.0f;
+	else if (x > 126.0f) x = 126.0f;
+	i = (int)(x + 0.5f);
+	if ((float)i > x + 0.5f) i--;
+	f = (x - i) * 0.693147181f;
+	p = 1.0f + f * (1.0f + f * (1.0f / 2 + f * (1.0f / 6 + f * (1.0f / 24 + f * (1.0f / 120 + f * (1.0f / 720))))));
+	bits = (tsf_u32)(i + 127) << 23;
+	TSF_MEMCPY(&scale, &bits, sizeof(scale));
+	return p * scale;
+}
+static double tsf_timecents2Secsd(double timecents) { return tsf_exp2(timecents * (1.0 / 1200.0)); }
+#else
 static double tsf_timecents2Secsd(double timecents) { return TSF_POW(2.0, timecents / 1200.0); }
+#endif
 static float tsf_timecents2Secsf(float timecents) { return TSF_POWF(2.0f, timecents / 1200.0f); }
 static float tsf_cents2Hertz(float cents) { return 8.176f * TSF_POWF(2.0f, cents / 1200.0f); }
+#ifndef TSF_NO_FAST_EXP2
+static float tsf_decibelsToGain(float db) { return (db > -100.f ? tsf_exp2f(db * 0.166096405f) : 0); } // 10^(db/20) = 2^(db * log2(10) / 20)
+#else
 static float tsf_decibelsToGain(float db) { return (db > -100.f ? TSF_POWF(10.0f, db * 0.05f) : 0); }
+#endif
 static float tsf_gainToDecibels(float gain) { return (gain <= .00001f ? -100.f : (float)(20.0 * TSF_LOG10(gain))); }
 
 static TSF_BOOL tsf_riffchunk_read(struct tsf_riffchunk* parent, struct tsf_riffchunk* chunk, struct tsf_stream* stream)
@@ -705,15 +1009,52 @@ static void tsf_region_envtosecs(struct tsf_envelope* p, TSF_BOOL sustainIsGain)
 	else p->sustain = 1.0f - (p->sustain / 1000.0f);
 }
 
+// Number of regions a preset expands to (instrument zones with a sample inside the preset zone's key and velocity ranges)
+static int tsf_load_preset_region_count(const struct tsf_hydra *hydra, const struct tsf_hydra_phdr *pphdr)
+{
+	enum { GenInstrument = 41, GenKeyRange = 43, GenVelRange = 44, GenSampleID = 53 };
+	const struct tsf_hydra_pbag *ppbag, *ppbagEnd;
+	int regionNum = 0;
+	for (ppbag = hydra->pbags + pphdr->presetBagNdx, ppbagEnd = hydra->pbags + pphdr[1].presetBagNdx; ppbag != ppbagEnd; ppbag++)
+	{
+		unsigned char plokey = 0, phikey = 127, plovel = 0, phivel = 127;
+		const struct tsf_hydra_pgen *ppgen, *ppgenEnd; const struct tsf_hydra_inst *pinst; const struct tsf_hydra_ibag *pibag, *pibagEnd; const struct tsf_hydra_igen *pigen, *pigenEnd;
+		for (ppgen = hydra->pgens + ppbag->genNdx, ppgenEnd = hydra->pgens + ppbag[1].genNdx; ppgen != ppgenEnd; ppgen++)
+		{
+			if (ppgen->genOper == GenKeyRange) { plokey = ppgen->genAmount.range.lo; phikey = ppgen->genAmount.range.hi; continue; }
+			if (ppgen->genOper == GenVelRange) { plovel = ppgen->genAmount.range.lo; phivel = ppgen->genAmount.range.hi; continue; }
+			if (ppgen->genOper != GenInstrument) continue;
+			if (ppgen->genAmount.wordAmount >= hydra->instNum) continue;
+			pinst = hydra->insts + ppgen->genAmount.wordAmount;
+			for (pibag = hydra->ibags + pinst->instBagNdx, pibagEnd = hydra->ibags + pinst[1].instBagNdx; pibag != pibagEnd; pibag++)
+			{
+				unsigned char ilokey = 0, ihikey = 127, ilovel = 0, ihivel = 127;
+				for (pigen = hydra->igens + pibag->instGenNdx, pigenEnd = hydra->igens + pibag[1].instGenNdx; pigen != pigenEnd; pigen++)
+				{
+					if (pigen->genOper == GenKeyRange) { ilokey = pigen->genAmount.range.lo; ihikey = pigen->genAmount.range.hi; continue; }
+					if (pigen->genOper == GenVelRange) { ilovel = pigen->genAmount.range.lo; ihivel = pigen->genAmount.range.hi; continue; }
+					if (pigen->genOper == GenSampleID && ihikey >= plokey && ilokey <= phikey && ihivel >= plovel && ilovel <= phivel) regionNum++;
+				}
+			}
+		}
+	}
+	return regionNum;
+}
+
 static int tsf_load_presets(tsf* res, struct tsf_hydra *hydra, unsigned int fontSampleCount)
 {
 	enum { GenInstrument = 41, GenKeyRange = 43, GenVelRange = 44, GenSampleID = 53 };
 	// Read each preset.
 	struct tsf_hydra_phdr *pphdr, *pphdrMax;
+	unsigned int arenaSize;
 	res->presetNum = hydra->phdrNum - 1;
-	res->presets = (struct tsf_preset*)TSF_MALLOC(res->presetNum * sizeof(struct tsf_preset));
+
+	// Presets and all their regions go into a single arena block
+	arenaSize = res->presetNum * (unsigned int)sizeof(struct tsf_preset) + TSF_ARENA_ALIGN;
+	for (pphdr = hydra->phdrs, pphdrMax = pphdr + hydra->phdrNum - 1; pphdr != pphdrMax; pphdr++)
+		arenaSize += tsf_load_preset_region_count(hydra, pphdr) * (unsigned int)sizeof(struct tsf_region) + TSF_ARENA_ALIGN;
+	res->presets = (struct tsf_preset*)tsf_arena_alloc(&res->arena, res->presetNum * sizeof(struct tsf_preset), arenaSize);
 	if (!res->presets) return 0;
-	else { int i; for (i = 0; i != res->presetNum; i++) res->presets[i].regions = TSF_NULL; }
 	for (pphdr = hydra->phdrs, pphdrMax = pphdr + hydra->phdrNum - 1; pphdr != pphdrMax; pphdr++)
 	{
 		int sortedIndex = 0, region_index = 0;
@@ -735,40 +1076,9 @@ static int tsf_load_presets(tsf* res, struct tsf_hydra *hydra, unsigned int font
 		preset->presetName[sizeof(preset->presetName)-1] = '\0'; //should be zero terminated in source file but make sure
 		preset->bank = pphdr->bank;
 		preset->preset = pphdr->preset;
-		preset->regionNum = 0;
-
-		//count regions covered by this preset
-		for (ppbag = hydra->pbags + pphdr->presetBagNdx, ppbagEnd = hydra->pbags + pphdr[1].presetBagNdx; ppbag != ppbagEnd; ppbag++)
-		{
-			unsigned char plokey = 0, phikey = 127, plovel = 0, phivel = 127;
-			struct tsf_hydra_pgen *ppgen, *ppgenEnd; struct tsf_hydra_inst *pinst; struct tsf_hydra_ibag *pibag, *pibagEnd; struct tsf_hydra_igen *pigen, *pigenEnd;
-			for (ppgen = hydra->pgens + ppbag->genNdx, ppgenEnd = hydra->pgens + ppbag[1].genNdx; ppgen != ppgenEnd; ppgen++)
-			{
-				if (ppgen->genOper == GenKeyRange) { plokey = ppgen->genAmount.range.lo; phikey = ppgen->genAmount.range.hi; continue; }
-				if (ppgen->genOper == GenVelRange) { plovel = ppgen->genAmount.range.lo; phivel = ppgen->genAmount.range.hi; continue; }
-				if (ppgen->genOper != GenInstrument) continue;
-				if (ppgen->genAmount.wordAmount >= hydra->instNum) continue;
-				pinst = hydra->insts + ppgen->genAmount.wordAmount;
-				for (pibag = hydra->ibags + pinst->instBagNdx, pibagEnd = hydra->ibags + pinst[1].instBagNdx; pibag != pibagEnd; pibag++)
-				{
-					unsigned char ilokey = 0, ihikey = 127, ilovel = 0, ihivel = 127;
-					for (pigen = hydra->igens + pibag->instGenNdx, pigenEnd = hydra->igens + pibag[1].instGenNdx; pigen != pigenEnd; pigen++)
-					{
-						if (pigen->genOper == GenKeyRange) { ilokey = pigen->genAmount.range.lo; ihikey = pigen->genAmount.range.hi; continue; }
-						if (pigen->genOper == GenVelRange) { ilovel = pigen->genAmount.range.lo; ihivel = pigen->genAmount.range.hi; continue; }
-						if (pigen->genOper == GenSampleID && ihikey >= plokey && ilokey <= phikey && ihivel >= plovel && ilovel <= phivel) preset->regionNum++;
-					}
-				}
-			}
-		}
-
-		preset->regions = (struct tsf_region*)TSF_MALLOC(preset->regionNum * sizeof(struct tsf_region));
-		if (!preset->regions)
-		{
-			int i; for (i = 0; i != res->presetNum; i++) TSF_FREE(res->presets[i].regions);
-			TSF_FREE(res->presets);
-			return 0;
-		}
+		preset->regionNum = tsf_load_preset_region_count(hydra, pphdr);
+		preset->regions = (struct tsf_region*)tsf_arena_alloc(&res->arena, preset->regionNum * sizeof(struct tsf_region), 0);
+		if (!preset->regions) return 0;
 		tsf_region_clear(&globalRegion, TSF_TRUE);
 
 		// Zones.
@@ -822,6 +1132,7 @@ static int tsf_load_presets(tsf* res, struct tsf_hydra *hydra, unsigned int font
 
 								// Fixup sample positions
 								pshdr = &hydra->shdrs[pigen->genAmount.wordAmount];
+								zoneRegion.sampleIndex = pigen->genAmount.wordAmount;
 								zoneRegion.offset += pshdr->start;
 								zoneRegion.end += pshdr->end;
 								zoneRegion.loop_start += pshdr->startLoop;
@@ -972,6 +1283,123 @@ static int tsf_decode_sf3_samples(const void* rawBuffer, float** pFloatBuffer, u
 }
 #endif
 
+// Part of the sample chunk that is already PCM, converted to float at 'out' in the sample buffer
+struct tsf_pcm_range { tsf_u32 in, num, out; };
+
+// Places the samples of a SoundFont which may contain compressed (SF3) samples in one float buffer and
+// fixes up the sample headers. Compressed samples get a decode job with its length and raw PCM parts a
+// range to convert, both in the order of the buffer. jobs, jobOut and pcms need room for shdrNum entries.
+// Returns the number of floats needed.
+static tsf_u32 tsf_layout_sf3_samples(const void* rawBuffer, tsf_u32 smplLength, struct tsf_hydra *hydra, const struct tsf_sample_decoder* decoder, struct tsf_decode_job* jobs, tsf_u32* jobOut, int* pJobNum, struct tsf_pcm_range* pcms, int* pPcmNum)
+{
+	const tsf_u8* smplBuffer = (const tsf_u8*)rawBuffer;
+	tsf_u32 resNum = 0;
+	int i, shdrLast = hydra->shdrNum - 1, jobNum = 0, pcmNum = 0, is_sf3 = 0;
+
+	for (i = 0; i <= shdrLast; i++)
+	{
+		struct tsf_hydra_shdr *shdr = &hydra->shdrs[i];
+		if (shdr->sampleType & 0x30) // compression flags (sometimes Vorbis flag)
+		{
+			const tsf_u8 *pSmpl = smplBuffer + shdr->start;
+			tsf_u32 size = (shdr->end > shdr->start && shdr->end <= smplLength ? shdr->end - shdr->start : 0), length;
+			if (size < 4 || !TSF_FourCCEquals(pSmpl, "OggS") || !(length = decoder->get_length(decoder->data, pSmpl, size)))
+			{
+				shdr->start = shdr->end = shdr->startLoop = shdr->endLoop = 0;
+				continue;
+			}
+
+			// Fix up sample indices in shdr, the samples are decoded once all are placed
+			shdr->start = resNum;
+			shdr->startLoop += resNum;
+			shdr->endLoop += resNum;
+			jobs[jobNum].compressed = pSmpl;
+			jobs[jobNum].size = size;
+			jobs[jobNum].out = TSF_NULL;
+			jobs[jobNum].length = length;
+			jobOut[jobNum++] = resNum;
+			shdr->end = resNum + length;
+			resNum += length + 46; // silence after each sample as in uncompressed SoundFonts
+			is_sf3 = 1;
+		}
+		else // raw PCM sample
+		{
+			tsf_u32 in = resNum, inEnd;
+			if (is_sf3 && i == shdrLast) continue; // the terminal record has no data of its own
+			if (is_sf3) // Fix up sample indices in shdr
+			{
+				in = shdr->start;
+				shdr->end = shdr->end - shdr->start + resNum;
+				shdr->startLoop = shdr->startLoop - shdr->start + resNum;
+				shdr->endLoop = shdr->endLoop - shdr->start + resNum;
+				shdr->start = resNum;
+			}
+			inEnd = in + ((shdr->end >= shdr->endLoop ? shdr->end : shdr->endLoop) - resNum);
+			if (i == shdrLast || inEnd > smplLength / sizeof(short)) inEnd = smplLength / sizeof(short);
+			if (inEnd <= in) continue;
+			pcms[pcmNum].in = in;
+			pcms[pcmNum].num = inEnd - in;
+			pcms[pcmNum++].out = resNum;
+			resNum += inEnd - in;
+		}
+	}
+	*pJobNum = jobNum;
+	*pPcmNum = pcmNum;
+	return resNum;
+}
+
+static void tsf_convert_pcm_range(const void* rawBuffer, float* res, const struct tsf_pcm_range* pcm)
+{
+	const short *in = (const short*)rawBuffer + pcm->in, *inEnd = in + pcm->num;
+	float* out = res + pcm->out;
+	while (in != inEnd) *(out++) = (float)(*(in++) / 32767.0);
+}
+
+// Decodes SF3 samples like tsf_decode_sf3_samples, but with an application provided decoder which
+// gets all compressed samples at once. The output layout is computed first so each sample has its final place.
+static int tsf_decode_sf3_samples_with(const void* rawBuffer, float** pFloatBuffer, unsigned int* pSmplCount, struct tsf_hydra *hydra, const struct tsf_sample_decoder* decoder)
+{
+	struct tsf_decode_job* jobs;
+	struct tsf_pcm_range* pcms;
+	tsf_u32* jobOut;
+	tsf_u32 resNum;
+	float* res;
+	int i, jobNum, pcmNum, ok;
+
+	jobs = (struct tsf_decode_job*)TSF_MALLOC(hydra->shdrNum * (sizeof(struct tsf_decode_job) + sizeof(struct tsf_pcm_range) + sizeof(tsf_u32)) + 1);
+	if (!jobs) return 0;
+	pcms = (struct tsf_pcm_range*)(jobs + hydra->shdrNum);
+	jobOut = (tsf_u32*)(pcms + hydra->shdrNum);
+	resNum = tsf_layout_sf3_samples(rawBuffer, *pSmplCount, hydra, decoder, jobs, jobOut, &jobNum, pcms, &pcmNum);
+
+	res = (float*)TSF_MALLOC((resNum ? resNum : 1) * sizeof(float));
+	ok = (res != TSF_NULL);
+	for (i = 0; ok && i != pcmNum; i++)
+		tsf_convert_pcm_range(rawBuffer, res, &pcms[i]);
+	for (i = 0; ok && i != jobNum; i++)
+	{
+		jobs[i].out = res + jobOut[i];
+		TSF_MEMSET(jobs[i].out + jobs[i].length, 0, 46 * sizeof(float));
+	}
+	if (ok && jobNum && !decoder->decode(decoder->data, jobs, jobNum)) ok = 0;
+	TSF_FREE(jobs);
+	if (!ok) { TSF_FREE(res); return 0; }
+	*pFloatBuffer = res;
+	*pSmplCount = resNum;
+	return 1;
+}
+
+// State of a two-phase load which decodes compressed (SF3) samples, the jobs and PCM ranges are
+// worked through in the order of the sample buffer by tsf_load_deferred_step
+struct tsf_deferred_decode
+{
+	struct tsf_sample_decoder decoder;
+	void* rawBuffer; // the sample chunk, freed once all samples are in fontSamples
+	struct tsf_decode_job* jobs;
+	struct tsf_pcm_range* pcms;
+	int jobNum, pcmNum, jobNext, pcmNext;
+};
+
 static int tsf_load_samples(void** pRawBuffer, float** pFloatBuffer, unsigned int* pSmplCount, struct tsf_riffchunk *chunkSmpl, struct tsf_stream* stream)
 {
 	#ifdef STB_VORBIS_INCLUDE_STB_VORBIS_H
@@ -1141,20 +1569,95 @@ static void tsf_voice_envelope_process(struct tsf_voice_envelope* e, int numSamp
 		tsf_voice_envelope_nextsegment(e, e->segment, outSampleRate);
 }
 
-static void tsf_voice_lowpass_setup(struct tsf_voice_lowpass* e, float Fc)
+static void tsf_voice_lowpass_buildtable(tsf* f)
+{
+	int i;
+	for (i = 0; i != TSF_LOWPASS_TABLESIZE; i++)
+	{
+		double Fc = tsf_cents2Hertz((float)(i * TSF_LOWPASS_CENTSSTEP)) / f->outSampleRate;
+		f->lowpassTable[i] = (float)TSF_TAN(TSF_PI * (Fc < 0.499 ? Fc : 0.499));
+	}
+	f->lowpassTableSampleRate = f->outSampleRate;
+	f->lowpassMaxCents = (float)(1200.0 * TSF_LOG(0.499 * f->outSampleRate / 8.176) / TSF_LOG(2.0));
+}
+
+static void tsf_voice_lowpass_setup(tsf* f, struct tsf_voice_lowpass* e, float cutoffCents)
 {
 	// Lowpass filter from http://www.earlevel.com/main/2012/11/26/biquad-c-source-code/
-	double K = TSF_TAN(TSF_PI * Fc), KK = K * K;
-	double norm = 1 / (1 + K * e->QInv + KK);
+	float pos, K, KK, norm;
+	int index;
+	e->active = (cutoffCents <= TSF_LOWPASS_MAXCENTS && cutoffCents < f->lowpassMaxCents);
+	if (!e->active) return;
+	pos = (cutoffCents > 0 ? cutoffCents * (1.0f / TSF_LOWPASS_CENTSSTEP) : 0);
+	index = (int)pos;
+	if (index > TSF_LOWPASS_TABLESIZE - 2) index = TSF_LOWPASS_TABLESIZE - 2;
+	K = f->lowpassTable[index] + (f->lowpassTable[index + 1] - f->lowpassTable[index]) * (pos - index);
+	KK = K * K;
+	norm = 1 / (1 + K * e->QInv + KK);
 	e->a0 = KK * norm;
 	e->a1 = 2 * e->a0;
 	e->b1 = 2 * (KK - 1) * norm;
 	e->b2 = (1 - K * e->QInv + KK) * norm;
 }
 
-static float tsf_voice_lowpass_process(struct tsf_voice_lowpass* e, double In)
+// Runs the lowpass filters of up to TSF_LOWPASS_LANES voices at once. The samples of
+// all lanes are interleaved (one frame of TSF_LOWPASS_LANES floats per sample).
+static void tsf_voice_lowpass_process_lanes(struct tsf_voice** voices, int laneCount, float* samples, int numSamples)
 {
-	double Out = In * e->a0 + e->z1; e->z1 = In * e->a1 + e->z2 - e->b1 * Out; e->z2 = In * e->a0 - e->b2 * Out; return (float)Out;
+	float a0[TSF_LOWPASS_LANES], a1[TSF_LOWPASS_LANES], b1[TSF_LOWPASS_LANES], b2[TSF_LOWPASS_LANES], z1[TSF_LOWPASS_LANES], z2[TSF_LOWPASS_LANES];
+	int lane, i;
+	for (lane = 0; lane != TSF_LOWPASS_LANES; lane++)
+	{
+		if (lane < laneCount)
+		{
+			struct tsf_voice_lowpass* e = &voices[lane]->lowpass;
+			a0[lane] = e->a0, a1[lane] = e->a1, b1[lane] = e->b1, b2[lane] = e->b2, z1[lane] = e->z1, z2[lane] = e->z2;
+		}
+		else a0[lane] = a1[lane] = b1[lane] = b2[lane] = z1[lane] = z2[lane] = 0;
+	}
+
+	#if defined(TSF_SIMD_SSE)
+	{
+		__m128 A0 = _mm_loadu_ps(a0), A1 = _mm_loadu_ps(a1), B1 = _mm_loadu_ps(b1), B2 = _mm_loadu_ps(b2), Z1 = _mm_loadu_ps(z1), Z2 = _mm_loadu_ps(z2);
+		for (i = 0; i != numSamples; i++, samples += TSF_LOWPASS_LANES)
+		{
+			__m128 In = _mm_loadu_ps(samples), Out = _mm_add_ps(_mm_mul_ps(In, A0), Z1);
+			Z1 = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(In, A1), Z2), _mm_mul_ps(B1, Out));
+			Z2 = _mm_sub_ps(_mm_mul_ps(In, A0), _mm_mul_ps(B2, Out));
+			_mm_storeu_ps(samples, Out);
+		}
+		_mm_storeu_ps(z1, Z1); _mm_storeu_ps(z2, Z2);
+	}
+	#elif defined(TSF_SIMD_NEON)
+	{
+		float32x4_t A0 = vld1q_f32(a0), A1 = vld1q_f32(a1), B1 = vld1q_f32(b1), B2 = vld1q_f32(b2), Z1 = vld1q_f32(z1), Z2 = vld1q_f32(z2);
+		for (i = 0; i != numSamples; i++, samples += TSF_LOWPASS_LANES)
+		{
+			float32x4_t In = vld1q_f32(samples), Out = vaddq_f32(vmulq_f32(In, A0), Z1);
+			Z1 = vsubq_f32(vaddq_f32(vmulq_f32(In, A1), Z2), vmulq_f32(B1, Out));
+			Z2 = vsubq_f32(vmulq_f32(In, A0), vmulq_f32(B2, Out));
+			vst1q_f32(samples, Out);
+		}
+		vst1q_f32(z1, Z1); vst1q_f32(z2, Z2);
+	}
+	#else
+	for (i = 0; i != numSamples; i++, samples += TSF_LOWPASS_LANES)
+		for (lane = 0; lane != TSF_LOWPASS_LANES; lane++)
+		{
+			float In = samples[lane], Out = In * a0[lane] + z1[lane];
+			z1[lane] = In * a1[lane] + z2[lane] - b1[lane] * Out;
+			z2[lane] = In * a0[lane] - b2[lane] * Out;
+			samples[lane] = Out;
+		}
+	#endif
+
+	// Store the filter state back, flushing denormals so decaying voices don't slow down.
+	for (lane = 0; lane != laneCount; lane++)
+	{
+		struct tsf_voice_lowpass* e = &voices[lane]->lowpass;
+		e->z1 = (z1[lane] > -1e-15f && z1[lane] < 1e-15f ? 0 : z1[lane]);
+		e->z2 = (z2[lane] > -1e-15f && z2[lane] < 1e-15f ? 0 : z2[lane]);
+	}
 }
 
 static void tsf_voice_lfo_setup(struct tsf_voice_lfo* e, float delay, int freqCents, float outSampleRate)
@@ -1217,156 +1720,354 @@ static void tsf_voice_calcpitchratio(struct tsf_voice* v, float pitchShift, floa
 	v->pitchOutputFactor = v->region->sample_rate / (tsf_timecents2Secsd(v->region->pitch_keycenter * 100.0) * outSampleRate);
 }
 
-static void tsf_voice_render(tsf* f, struct tsf_voice* v, float* outputBuffer, int numSamples)
+// Sample of a streamed voice, either resident or from its stream ring if it has been read ahead that far.
+static float tsf_voice_stream_read(const tsf* f, const struct tsf_voice* v, unsigned int pos, unsigned int available, TSF_BOOL* underrun)
 {
-	struct tsf_region* region = v->region;
-	float* input = f->fontSamples;
-	float* outL = outputBuffer;
-	float* outR = (f->outputmode == TSF_STEREO_UNWEAVED ? outL + numSamples : TSF_NULL);
-
-	// Cache some values, to give them at least some chance of ending up in registers.
-	TSF_BOOL updateModEnv = (region->modEnvToPitch || region->modEnvToFilterFc);
-	TSF_BOOL updateModLFO = (v->modlfo.delta && (region->modLfoToPitch || region->modLfoToFilterFc || region->modLfoToVolume));
-	TSF_BOOL updateVibLFO = (v->viblfo.delta && (region->vibLfoToPitch));
-	TSF_BOOL isLooping    = (v->loopStart < v->loopEnd);
-	unsigned int tmpLoopStart = v->loopStart, tmpLoopEnd = v->loopEnd;
-	double tmpSampleEndDbl = (double)region->end, tmpLoopEndDbl = (double)tmpLoopEnd + 1.0;
-	double tmpSourceSamplePosition = v->sourceSamplePosition;
-	struct tsf_voice_lowpass tmpLowpass = v->lowpass;
+	if (pos < v->region->streamStart) return f->fontSamples[pos - v->region->residentShift];
+	if (pos < available) return v->streamRing[pos & (TSF_STREAM_RINGSAMPLES - 1)];
+	*underrun = TSF_TRUE;
+	return 0;
+}
 
-	TSF_BOOL dynamicLowpass = (region->modLfoToFilterFc || region->modEnvToFilterFc);
-	float tmpSampleRate = f->outSampleRate, tmpInitialFilterFc, tmpModLfoToFilterFc, tmpModEnvToFilterFc;
+// Sample positions are 32.32 fixed point, the integer part is the sample index.
+#define TSF_FIXED_SHIFT 32
+static tsf_u64 tsf_fixed_from_ratio(double ratio) { return (tsf_u64)(ratio * 4294967296.0); }
+static float tsf_fixed_alpha(tsf_u64 position) { return (float)(int)((tsf_u32)position >> 9) * (1.0f / 8388608.0f); } // top 23 fraction bits
 
-	TSF_BOOL dynamicPitchRatio = (region->modLfoToPitch || region->modEnvToPitch || region->vibLfoToPitch);
-	double pitchRatio;
-	float tmpModLfoToPitch, tmpVibLfoToPitch, tmpModEnvToPitch;
+// Sets the mipmap span a region reads, returns 0 if it can't use the mipmaps (streamed, empty or starting past its loop)
+static int tsf_mipspan_key(const struct tsf_region* region, struct tsf_mipspan* key)
+{
+	TSF_BOOL looped = (region->loop_mode != TSF_LOOPMODE_NONE && region->loop_start < region->loop_end);
+	if (region->streamStart || region->end <= region->offset || (looped && region->loop_end < region->offset)) return 0;
+	key->offset = region->offset;
+	key->end = region->end;
+	key->loopStart = (looped ? region->loop_start : 0);
+	key->loopEnd = (looped ? region->loop_end : 0);
+	key->residentShift = region->residentShift;
+	return 1;
+}
 
-	TSF_BOOL dynamicGain = (region->modLfoToVolume != 0);
-	float noteGain = 0, tmpModLfoToVolume;
+static int tsf_mipspan_compare(const struct tsf_mipspan* a, const struct tsf_mipspan* b)
+{
+	if (a->offset != b->offset) return (a->offset < b->offset ? -1 : 1);
+	if (a->end != b->end) return (a->end < b->end ? -1 : 1);
+	if (a->loopStart != b->loopStart) return (a->loopStart < b->loopStart ? -1 : 1);
+	if (a->loopEnd != b->loopEnd) return (a->loopEnd < b->loopEnd ? -1 : 1);
+	if (a->residentShift != b->residentShift) return (a->residentShift < b->residentShift ? -1 : 1);
+	return 0;
+}
 
-	if (dynamicLowpass) tmpInitialFilterFc = (float)region->initialFilterFc, tmpModLfoToFilterFc = (float)region->modLfoToFilterFc, tmpModEnvToFilterFc = (float)region->modEnvToFilterFc;
-	else tmpInitialFilterFc = 0, tmpModLfoToFilterFc = 0, tmpModEnvToFilterFc = 0;
+static int tsf_mipspan_find(const tsf* f, const struct tsf_region* region)
+{
+	struct tsf_mipspan key;
+	int low = 0, high = f->mipSpanNum, mid, cmp;
+	if (!tsf_mipspan_key(region, &key)) return -1;
+	while (low < high)
+	{
+		mid = (low + high) / 2;
+		cmp = tsf_mipspan_compare(&f->mipSpans[mid], &key);
+		if (!cmp) return mid;
+		if (cmp < 0) low = mid + 1; else high = mid;
+	}
+	return -1;
+}
 
-	if (dynamicPitchRatio) pitchRatio = 0, tmpModLfoToPitch = (float)region->modLfoToPitch, tmpVibLfoToPitch = (float)region->vibLfoToPitch, tmpModEnvToPitch = (float)region->modEnvToPitch;
-	else pitchRatio = tsf_timecents2Secsd(v->pitchInputTimecents) * v->pitchOutputFactor, tmpModLfoToPitch = 0, tmpVibLfoToPitch = 0, tmpModEnvToPitch = 0;
+// Sample table level for a voice playing at the given rate, the octave that brings the rate closest to 1.
+// Stays on the current level slightly past the half-octave boundary so vibrato doesn't flip between levels.
+static int tsf_voice_mipmap_level(const tsf* f, struct tsf_voice* v, double pitchRatio, TSF_BOOL isLooping)
+{
+	int level = v->mipLevel, levels = f->mipLevels;
+	const struct tsf_mipspan* span;
+	if (!levels) return 0;
+	if (v->mipSpan == -2) v->mipSpan = tsf_mipspan_find(f, v->region);
+	if (v->mipSpan < 0) return 0;
+
+	// A sustain loop that was let go plays on past its end, where the tables hold more of the loop
+	span = &f->mipSpans[v->mipSpan];
+	if (span->loopStart != span->loopEnd && !isLooping) return 0;
+	if (level > levels) level = levels;
+	while (level < levels && pitchRatio > (double)(1 << level) * 1.5) level++;
+	while (level > 0 && pitchRatio < (double)(1 << level) * 0.6875) level--;
+	return level;
+}
+
+// Gain and playback rate of a voice for its current envelope and LFO state.
+static void tsf_voice_calccontrols(struct tsf_voice* v, float* gainMono, double* pitchRatio)
+{
+	struct tsf_region* region = v->region;
+	float vibLfoToPitch = (float)region->vibLfoToPitch + v->vibratoDepth;
+	double pitchTimecents = v->pitchInputTimecents + v->glideTimecents;
 
-	if (dynamicGain) tmpModLfoToVolume = (float)region->modLfoToVolume * 0.1f;
-	else noteGain = tsf_decibelsToGain(v->noteGainDB), tmpModLfoToVolume = 0;
+	if (region->modLfoToPitch || region->modEnvToPitch || vibLfoToPitch)
+		*pitchRatio = tsf_timecents2Secsd(pitchTimecents + (v->modlfo.level * (float)region->modLfoToPitch + v->viblfo.level * vibLfoToPitch + v->modenv.level * (float)region->modEnvToPitch)) * v->pitchOutputFactor;
+	else
+		*pitchRatio = tsf_timecents2Secsd(pitchTimecents) * v->pitchOutputFactor;
 
-	while (numSamples)
+	if (region->modLfoToVolume)
+		*gainMono = tsf_decibelsToGain(v->noteGainDB + (v->modlfo.level * ((float)region->modLfoToVolume * 0.1f))) * v->ampenv.level;
+	else
+		*gainMono = tsf_decibelsToGain(v->noteGainDB) * v->ampenv.level;
+}
+
+// Moves a gliding voice blockSamples closer to its target pitch. Only the control values at the block
+// ends follow the glide, the rate ramp between them makes it continuous within the block.
+static void tsf_voice_glide_process(struct tsf_voice* v, int blockSamples)
+{
+	if (blockSamples >= v->glideSamples) { v->glideTimecents = 0.0; v->glideSamples = 0; return; }
+	v->glideTimecents -= v->glideTimecents * blockSamples / v->glideSamples;
+	v->glideSamples -= blockSamples;
+}
+
+// Renders the next effect block of a voice as unfiltered mono samples written every 'stride' floats.
+// Updates the voice's filter coefficients, envelopes and LFOs, and returns the number of samples
+// written along with the gain ramp to mix them with. Gain and pitch move linearly from their
+// values at the end of the previous block to those at the end of this one. Voices that reach
+// their end are killed.
+static int tsf_voice_render(tsf* f, struct tsf_voice* v, float* output, int stride, int blockSamples, float* gainStart, float* gainStep)
+{
+	struct tsf_region* region = v->region;
+	float* input = f->fontSamples;
+	TSF_BOOL isLooping = (v->loopStart < v->loopEnd), wrapped = v->loopWrapped;
+	unsigned int tmpLoopStart = v->loopStart, tmpLoopEnd = v->loopEnd;
+	tsf_u64 position = v->sourceSamplePosition, increment, incrementStep;
+	tsf_u64 endPosition = (tsf_u64)region->end << TSF_FIXED_SHIFT;
+	tsf_u64 loopEndPosition = ((tsf_u64)tmpLoopEnd + 1) << TSF_FIXED_SHIFT, loopLength = ((tsf_u64)tmpLoopEnd - tmpLoopStart + 1) << TSF_FIXED_SHIFT;
+	double pitchRatio, reach;
+	unsigned int residentShift = region->residentShift;
+	int i, level;
+
+	if (region->modLfoToFilterFc || region->modEnvToFilterFc)
+		tsf_voice_lowpass_setup(f, &v->lowpass, (float)region->initialFilterFc + v->modlfo.level * (float)region->modLfoToFilterFc + v->modenv.level * (float)region->modEnvToFilterFc);
+
+	if (!v->controlValid)
 	{
-		float gainMono, gainLeft, gainRight;
-		int blockSamples = (numSamples > TSF_RENDER_EFFECTSAMPLEBLOCK ? TSF_RENDER_EFFECTSAMPLEBLOCK : numSamples);
-		numSamples -= blockSamples;
+		tsf_voice_calccontrols(v, &v->controlGain, &v->controlPitchRatio);
+		v->controlValid = TSF_TRUE;
+	}
+	*gainStart = v->controlGain;
+	pitchRatio = v->controlPitchRatio;
+	level = v->mipLevel = tsf_voice_mipmap_level(f, v, pitchRatio, isLooping);
 
-		if (dynamicLowpass)
-		{
-			float fres = tmpInitialFilterFc + v->modlfo.level * tmpModLfoToFilterFc + v->modenv.level * tmpModEnvToFilterFc;
-			float lowpassFc = (fres <= 13500 ? tsf_cents2Hertz(fres) / tmpSampleRate : 1.0f);
-			tmpLowpass.active = (lowpassFc < 0.499f);
-			if (tmpLowpass.active) tsf_voice_lowpass_setup(&tmpLowpass, lowpassFc);
-		}
+	// Update EG.
+	tsf_voice_envelope_process(&v->ampenv, blockSamples, f->outSampleRate);
+	if (region->modEnvToPitch || region->modEnvToFilterFc) tsf_voice_envelope_process(&v->modenv, blockSamples, f->outSampleRate);
 
-		if (dynamicPitchRatio)
-			pitchRatio = tsf_timecents2Secsd(v->pitchInputTimecents + (v->modlfo.level * tmpModLfoToPitch + v->viblfo.level * tmpVibLfoToPitch + v->modenv.level * tmpModEnvToPitch)) * v->pitchOutputFactor;
+	// Update LFOs.
+	if (v->modlfo.delta && (region->modLfoToPitch || region->modLfoToFilterFc || region->modLfoToVolume)) tsf_voice_lfo_process(&v->modlfo, blockSamples);
+	if (v->viblfo.delta && (region->vibLfoToPitch || v->vibratoDepth)) tsf_voice_lfo_process(&v->viblfo, blockSamples);
 
-		if (dynamicGain)
-			noteGain = tsf_decibelsToGain(v->noteGainDB + (v->modlfo.level * tmpModLfoToVolume));
+	// Update pitch glide.
+	if (v->glideSamples) tsf_voice_glide_process(v, blockSamples);
 
-		gainMono = noteGain * v->ampenv.level;
+	tsf_voice_calccontrols(v, &v->controlGain, &v->controlPitchRatio);
+	*gainStep = (v->controlGain - *gainStart) / blockSamples;
 
-		// Update EG.
-		tsf_voice_envelope_process(&v->ampenv, blockSamples, tmpSampleRate);
-		if (updateModEnv) tsf_voice_envelope_process(&v->modenv, blockSamples, tmpSampleRate);
+	// Position increment per sample, ramped in integer steps (wrapping add of a signed step)
+	increment = tsf_fixed_from_ratio(pitchRatio);
+	incrementStep = (tsf_u64)(((tsf_s64)tsf_fixed_from_ratio(v->controlPitchRatio) - (tsf_s64)increment) / blockSamples);
 
-		// Update LFOs.
-		if (updateModLFO) tsf_voice_lfo_process(&v->modlfo, blockSamples);
-		if (updateVibLFO) tsf_voice_lfo_process(&v->viblfo, blockSamples);
+	// Furthest sample index this block can read
+	reach = (double)(position >> TSF_FIXED_SHIFT) + blockSamples * (pitchRatio > v->controlPitchRatio ? pitchRatio : v->controlPitchRatio) + 2.0;
+	if (isLooping && reach > tmpLoopEnd) reach = tmpLoopEnd;
 
-		switch (f->outputmode)
+	if (level)
+	{
+		// Read the span's decimated table, positions stay in full rate sample indices. Once the
+		// voice has wrapped, it reads the loop's second copy which has the loop's end before it.
+		const struct tsf_mipspan* span = &f->mipSpans[v->mipSpan];
+		const float* mip = f->mipSamples[level - 1] + span->start[level - 1];
+		tsf_u64 baseOffset = (tsf_u64)span->base << TSF_FIXED_SHIFT;
+		for (i = 0; i != blockSamples && position < endPosition; i++, output += stride)
 		{
-			case TSF_STEREO_INTERLEAVED:
-				gainLeft = gainMono * v->panFactorLeft, gainRight = gainMono * v->panFactorRight;
-				while (blockSamples-- && tmpSourceSamplePosition < tmpSampleEndDbl)
-				{
-					unsigned int pos = (unsigned int)tmpSourceSamplePosition, nextPos = (pos >= tmpLoopEnd && isLooping ? tmpLoopStart : pos + 1);
+			tsf_u64 mipPosition = (position - baseOffset + (wrapped ? loopLength : 0)) >> level;
+			unsigned int pos = (unsigned int)(mipPosition >> TSF_FIXED_SHIFT);
 
-					// Simple linear interpolation.
-					float alpha = (float)(tmpSourceSamplePosition - pos), val = (input[pos] * (1.0f - alpha) + input[nextPos] * alpha);
+			// Simple linear interpolation.
+			float alpha = tsf_fixed_alpha(mipPosition);
+			*output = (mip[pos] * (1.0f - alpha) + mip[pos + 1] * alpha);
 
-					// Low-pass filter.
-					if (tmpLowpass.active) val = tsf_voice_lowpass_process(&tmpLowpass, val);
+			// Next sample.
+			position += increment;
+			increment += incrementStep;
+			if (position >= loopEndPosition && isLooping) { position -= loopLength; wrapped = TSF_TRUE; }
+		}
+	}
+	else if (!region->streamStart || reach < region->streamStart)
+	{
+		for (i = 0; i != blockSamples && position < endPosition; i++, output += stride)
+		{
+			unsigned int pos = (unsigned int)(position >> TSF_FIXED_SHIFT), nextPos = (pos >= tmpLoopEnd && isLooping ? tmpLoopStart : pos + 1);
 
-					*outL++ += val * gainLeft;
-					*outL++ += val * gainRight;
+			// Simple linear interpolation.
+			float alpha = tsf_fixed_alpha(position);
+			*output = (input[pos - residentShift] * (1.0f - alpha) + input[nextPos - residentShift] * alpha);
 
-					// Next sample.
-					tmpSourceSamplePosition += pitchRatio;
-					if (tmpSourceSamplePosition >= tmpLoopEndDbl && isLooping) tmpSourceSamplePosition -= (tmpLoopEnd - tmpLoopStart + 1.0);
-				}
-				break;
+			// Next sample.
+			position += increment;
+			increment += incrementStep;
+			if (position >= loopEndPosition && isLooping) { position -= loopLength; wrapped = TSF_TRUE; }
+		}
+	}
+	else
+	{
+		// Part of this block lies past the resident samples, read those from the voice's stream ring.
+		TSF_BOOL underrun = TSF_FALSE;
+		unsigned int available = region->streamStart;
+		if (v->streamServed == v->streamRequest)
+		{
+			TSF_MEMORY_BARRIER();
+			available = v->streamEnd;
+		}
+		for (i = 0; i != blockSamples && position < endPosition; i++, output += stride)
+		{
+			unsigned int pos = (unsigned int)(position >> TSF_FIXED_SHIFT), nextPos = (pos >= tmpLoopEnd && isLooping ? tmpLoopStart : pos + 1);
 
-			case TSF_STEREO_UNWEAVED:
-				gainLeft = gainMono * v->panFactorLeft, gainRight = gainMono * v->panFactorRight;
-				while (blockSamples-- && tmpSourceSamplePosition < tmpSampleEndDbl)
-				{
-					unsigned int pos = (unsigned int)tmpSourceSamplePosition, nextPos = (pos >= tmpLoopEnd && isLooping ? tmpLoopStart : pos + 1);
+			// Simple linear interpolation.
+			float alpha = tsf_fixed_alpha(position);
+			*output = (tsf_voice_stream_read(f, v, pos, available, &underrun) * (1.0f - alpha) + tsf_voice_stream_read(f, v, nextPos, available, &underrun) * alpha);
 
-					// Simple linear interpolation.
-					float alpha = (float)(tmpSourceSamplePosition - pos), val = (input[pos] * (1.0f - alpha) + input[nextPos] * alpha);
+			// Next sample.
+			position += increment;
+			increment += incrementStep;
+			if (position >= loopEndPosition && isLooping) position -= loopLength;
+		}
+		if (underrun) f->streamUnderruns++;
+	}
 
-					// Low-pass filter.
-					if (tmpLowpass.active) val = tsf_voice_lowpass_process(&tmpLowpass, val);
+	v->sourceSamplePosition = position;
+	v->loopWrapped = wrapped;
+	if (region->streamStart) v->streamReadPos = (unsigned int)(position >> TSF_FIXED_SHIFT);
+	if (position >= endPosition || v->ampenv.segment == TSF_SEGMENT_DONE)
+		tsf_voice_kill(v);
+	return i;
+}
 
-					*outL++ += val * gainLeft;
-					*outR++ += val * gainRight;
+// Adds samples rendered by tsf_voice_render to the output buffer at the given sample offset.
+static void tsf_voice_mix(tsf* f, struct tsf_voice* v, const float* input, int stride, int numSamples, float gainMono, float gainStep, float* buffer, int offset, int bufferSamples)
+{
+	float gainLeft = gainMono * v->panFactorLeft, gainRight = gainMono * v->panFactorRight;
+	float stepLeft = gainStep * v->panFactorLeft, stepRight = gainStep * v->panFactorRight;
+	float *outL, *outR;
+	switch (f->outputmode)
+	{
+		case TSF_STEREO_INTERLEAVED:
+			for (outL = buffer + offset * 2; numSamples--; input += stride, gainLeft += stepLeft, gainRight += stepRight)
+			{
+				*outL++ += *input * gainLeft;
+				*outL++ += *input * gainRight;
+			}
+			break;
 
-					// Next sample.
-					tmpSourceSamplePosition += pitchRatio;
-					if (tmpSourceSamplePosition >= tmpLoopEndDbl && isLooping) tmpSourceSamplePosition -= (tmpLoopEnd - tmpLoopStart + 1.0);
-				}
-				break;
+		case TSF_STEREO_UNWEAVED:
+			for (outL = buffer + offset, outR = outL + bufferSamples; numSamples--; input += stride, gainLeft += stepLeft, gainRight += stepRight)
+			{
+				*outL++ += *input * gainLeft;
+				*outR++ += *input * gainRight;
+			}
+			break;
 
-			case TSF_MONO:
-				while (blockSamples-- && tmpSourceSamplePosition < tmpSampleEndDbl)
-				{
-					unsigned int pos = (unsigned int)tmpSourceSamplePosition, nextPos = (pos >= tmpLoopEnd && isLooping ? tmpLoopStart : pos + 1);
+		case TSF_MONO:
+			for (outL = buffer + offset; numSamples--; input += stride, gainMono += gainStep)
+				*outL++ += *input * gainMono;
+			break;
+	}
+}
 
-					// Simple linear interpolation.
-					float alpha = (float)(tmpSourceSamplePosition - pos), val = (input[pos] * (1.0f - alpha) + input[nextPos] * alpha);
+struct tsf_stream_counter { struct tsf_stream* stream; tsf_u32 position; };
+static int tsf_stream_counter_read(struct tsf_stream_counter* c, void* ptr, unsigned int size) { int res = c->stream->read(c->stream->data, ptr, size); c->position += (res > 0 ? res : 0); return res; }
+static int tsf_stream_counter_skip(struct tsf_stream_counter* c, unsigned int count) { int res = c->stream->skip(c->stream->data, count); if (res) c->position += count; return res; }
 
-					// Low-pass filter.
-					if (tmpLowpass.active) val = tsf_voice_lowpass_process(&tmpLowpass, val);
+// Loads the resident part of each sample for disk streaming and points the regions at it
+static int tsf_load_resident_samples(tsf* res, struct tsf_hydra* hydra, tsf_u32 smplCount, float preloadSeconds)
+{
+	tsf_u32 *residentStart, *residentNum, total = 0;
+	struct tsf_preset *preset, *presetEnd = res->presets + res->presetNum;
+	struct tsf_region *region, *regionEnd;
+	int i, ok = 1;
 
-					*outL++ += val * gainMono;
+	residentStart = (tsf_u32*)TSF_MALLOC(hydra->shdrNum * 2 * sizeof(tsf_u32));
+	if (!residentStart) return 0;
+	residentNum = residentStart + hydra->shdrNum;
 
-					// Next sample.
-					tmpSourceSamplePosition += pitchRatio;
-					if (tmpSourceSamplePosition >= tmpLoopEndDbl && isLooping) tmpSourceSamplePosition -= (tmpLoopEnd - tmpLoopStart + 1.0);
-				}
-				break;
-		}
+	// Resident length of each sample, the renderer reads up to and including the sample's end index
+	for (i = 0; i != hydra->shdrNum; i++)
+	{
+		struct tsf_hydra_shdr *shdr = &hydra->shdrs[i];
+		tsf_u32 fullNum = (shdr->end >= shdr->start && shdr->start < smplCount ? shdr->end + 2 - shdr->start : 0);
+		tsf_u32 preloadNum = (tsf_u32)(preloadSeconds * shdr->sampleRate);
+		if (fullNum > smplCount - shdr->start) fullNum = smplCount - shdr->start;
+		if (shdr->sampleType & 0x30) ok = 0; // compressed samples can't be streamed
+		residentNum[i] = (preloadNum < fullNum ? preloadNum : fullNum);
+	}
 
-		if (tmpSourceSamplePosition >= tmpSampleEndDbl || v->ampenv.segment == TSF_SEGMENT_DONE)
+	// Keep samples fully resident if a loop reaching into the streamed part doesn't fit into half a ring buffer
+	for (preset = res->presets; preset != presetEnd; preset++)
+		for (region = preset->regions, regionEnd = region + preset->regionNum; region != regionEnd; region++)
 		{
-			tsf_voice_kill(v);
-			return;
+			struct tsf_hydra_shdr *shdr = &hydra->shdrs[region->sampleIndex];
+			tsf_u32 streamStart = shdr->start + residentNum[region->sampleIndex];
+			if (region->loop_mode == TSF_LOOPMODE_NONE || region->loop_start >= region->loop_end || region->loop_end < streamStart) continue;
+			if (region->loop_end + 1 - (region->loop_start > streamStart ? region->loop_start : streamStart) > TSF_STREAM_RINGSAMPLES / 2)
+				residentNum[region->sampleIndex] = (shdr->end >= shdr->start ? shdr->end + 2 - shdr->start : 0);
 		}
+
+	for (i = 0; i != hydra->shdrNum; i++)
+	{
+		if (residentNum[i] > smplCount - hydra->shdrs[i].start) residentNum[i] = (hydra->shdrs[i].start < smplCount ? smplCount - hydra->shdrs[i].start : 0);
+		residentStart[i] = total;
+		total += residentNum[i];
+	}
+
+	res->fontSamples = (float*)TSF_MALLOC((total ? total : 1) * sizeof(float));
+	res->fontSampleNum = total;
+	if (!res->fontSamples) ok = 0;
+
+	// Read and convert each resident part in place from short to float
+	for (i = 0; ok && i != hydra->shdrNum; i++)
+	{
+		float *out = res->fontSamples + residentStart[i], *outEnd = out + residentNum[i];
+		const short* in = (const short*)out + residentNum[i];
+		tsf_u32 size = residentNum[i] * (tsf_u32)sizeof(short);
+		if (size && res->streamSource.read_at(res->streamSource.data, out, res->streamSmplOffset + hydra->shdrs[i].start * (tsf_u32)sizeof(short), size) != (int)size) ok = 0;
+		else while (outEnd != out) *(--outEnd) = (float)(*(--in) / 32767.0);
 	}
 
-	v->sourceSamplePosition = tmpSourceSamplePosition;
-	if (tmpLowpass.active || dynamicLowpass) v->lowpass = tmpLowpass;
+	for (preset = res->presets; ok && preset != presetEnd; preset++)
+		for (region = preset->regions, regionEnd = region + preset->regionNum; region != regionEnd; region++)
+		{
+			struct tsf_hydra_shdr *shdr = &hydra->shdrs[region->sampleIndex];
+			tsf_u32 fullNum = (shdr->end >= shdr->start ? shdr->end + 2 - shdr->start : 0);
+			region->residentShift = shdr->start - residentStart[region->sampleIndex];
+			region->streamStart = (residentNum[region->sampleIndex] < fullNum ? shdr->start + residentNum[region->sampleIndex] : 0);
+		}
+
+	TSF_FREE(residentStart);
+	return ok;
 }
 
-TSFDEF tsf* tsf_load(struct tsf_stream* stream)
+static tsf* tsf_load_internal(struct tsf_stream* stream, const struct tsf_stream_source* source, float preloadSeconds, TSF_BOOL deferSamples, const struct tsf_sample_decoder* decoder)
 {
 	tsf* res = TSF_NULL;
 	struct tsf_riffchunk chunkHead;
 	struct tsf_riffchunk chunkList;
 	struct tsf_hydra hydra;
+	struct tsf_arena_block* hydraArena = TSF_NULL; // hydra chunks, sized from the pdta list so they usually share one block
+	tsf_u8* hydraBuffer = TSF_NULL;
 	void* rawBuffer = TSF_NULL;
 	float* floatBuffer = TSF_NULL;
-	tsf_u32 smplCount = 0;
+	tsf_u32 smplCount = 0, smplOffset = 0;
+	struct tsf_stream_counter counter;
+	struct tsf_stream countedStream;
+
+	// When streaming or deferring the samples, count the bytes read to know where the sample data lives in the file
+	if (source)
+	{
+		counter.stream = stream, counter.position = 0;
+		countedStream.data = &counter;
+		countedStream.read = (int(*)(void*,void*,unsigned int))&tsf_stream_counter_read;
+		countedStream.skip = (int(*)(void*,unsigned int))&tsf_stream_counter_skip;
+		stream = &countedStream;
+	}
 
 	if (!tsf_riffchunk_read(TSF_NULL, &chunkHead, stream) || !TSF_FourCCEquals(chunkHead.id, "sfbk"))
 	{
@@ -1381,15 +2082,23 @@ TSFDEF tsf* tsf_load(struct tsf_stream* stream)
 		struct tsf_riffchunk chunk;
 		if (TSF_FourCCEquals(chunkList.id, "pdta"))
 		{
+			// All sub-chunks are read through one buffer that fits the whole list
+			tsf_u32 pdtaSize = chunkList.size;
+			TSF_FREE(hydraBuffer);
+			hydraBuffer = (tsf_u8*)TSF_MALLOC(pdtaSize ? pdtaSize : 1);
+			if (!hydraBuffer) goto out_of_memory;
 			while (tsf_riffchunk_read(&chunkList, &chunk, stream))
 			{
 				#define HandleChunk(chunkName) (TSF_FourCCEquals(chunk.id, #chunkName) && !(chunk.size % chunkName##SizeInFile)) \
 					{ \
-						int num = chunk.size / chunkName##SizeInFile, i; \
+						int num = chunk.size / chunkName##SizeInFile, i, got; \
+						const tsf_u8* record = hydraBuffer; \
 						hydra.chunkName##Num = num; \
-						hydra.chunkName##s = (struct tsf_hydra_##chunkName*)TSF_MALLOC(num * sizeof(struct tsf_hydra_##chunkName)); \
+						hydra.chunkName##s = (struct tsf_hydra_##chunkName*)tsf_arena_alloc(&hydraArena, num * sizeof(struct tsf_hydra_##chunkName), pdtaSize * 2); \
 						if (!hydra.chunkName##s) goto out_of_memory; \
-						for (i = 0; i < num; ++i) tsf_hydra_read_##chunkName(&hydra.chunkName##s[i], stream); \
+						got = stream->read(stream->data, hydraBuffer, chunk.size); \
+						if (got < (int)chunk.size) TSF_MEMSET(hydraBuffer + (got > 0 ? got : 0), 0, chunk.size - (got > 0 ? got : 0)); \
+						for (i = 0; i < num; ++i, record += chunkName##SizeInFile) tsf_hydra_read_##chunkName(&hydra.chunkName##s[i], record); \
 					}
 				enum
 				{
@@ -1408,7 +2117,21 @@ TSFDEF tsf* tsf_load(struct tsf_stream* stream)
 		{
 			while (tsf_riffchunk_read(&chunkList, &chunk, stream))
 			{
-				if ((TSF_FourCCEquals(chunk.id, "smpl")
+				if (source && TSF_FourCCEquals(chunk.id, "smpl") && !smplCount && chunk.size >= sizeof(short))
+				{
+					// Leave the samples on disk, tsf_load_resident_samples or tsf_load_deferred_step read them
+					smplOffset = counter.position;
+					smplCount = chunk.size / (unsigned int)sizeof(short);
+					stream->skip(stream->data, chunk.size);
+				}
+				else if (decoder && TSF_FourCCEquals(chunk.id, "smpl") && !rawBuffer && !floatBuffer && chunk.size >= sizeof(short))
+				{
+					// Keep the raw data, the sample headers tell which parts are compressed
+					smplCount = chunk.size;
+					rawBuffer = TSF_MALLOC(chunk.size);
+					if (!rawBuffer || !stream->read(stream->data, rawBuffer, chunk.size)) goto out_of_memory;
+				}
+				else if ((TSF_FourCCEquals(chunk.id, "smpl")
 						#ifdef STB_VORBIS_INCLUDE_STB_VORBIS_H
 						|| TSF_FourCCEquals(chunk.id, "smpo")
 						#endif
@@ -1425,40 +2148,476 @@ TSFDEF tsf* tsf_load(struct tsf_stream* stream)
 	{
 		//if (e) *e = TSF_INVALID_INCOMPLETE;
 	}
-	else if (!rawBuffer && !floatBuffer)
+	else if (!rawBuffer && !floatBuffer && !smplCount)
 	{
 		//if (e) *e = TSF_INVALID_NOSAMPLEDATA;
 	}
+	else if (source && deferSamples)
+	{
+		int i;
+		for (i = 0; i != hydra.shdrNum; i++)
+			if (hydra.shdrs[i].sampleType & 0x30) goto out_of_memory; // compressed samples need decoding up front
+		res = (tsf*)TSF_MALLOC(sizeof(tsf));
+		if (res) TSF_MEMSET(res, 0, sizeof(tsf));
+		if (!res || !tsf_load_presets(res, &hydra, smplCount)) goto out_of_memory;
+		res->outSampleRate = 44100.0f;
+		res->effectBlockSamples = TSF_RENDER_EFFECTSAMPLEBLOCK;
+		res->deferredSource = *source;
+		res->deferredSmplOffset = smplOffset;
+		res->fontSamples = (float*)TSF_MALLOC(smplCount * sizeof(float));
+		res->fontSampleNum = smplCount;
+		res->lowpassTable = (float*)TSF_MALLOC(TSF_LOWPASS_TABLESIZE * sizeof(float));
+		if (!res->fontSamples || !res->lowpassTable) { tsf_close(res); res = TSF_NULL; }
+		else tsf_voice_lowpass_buildtable(res);
+	}
+	else if (deferSamples && decoder && !floatBuffer)
+	{
+		// Place the samples now and keep the sample chunk to decode them in the second phase
+		struct tsf_deferred_decode* d;
+		tsf_u32 resNum, *jobOut;
+		int i;
+		d = (struct tsf_deferred_decode*)TSF_MALLOC(sizeof(struct tsf_deferred_decode) + hydra.shdrNum * (sizeof(struct tsf_decode_job) + sizeof(struct tsf_pcm_range) + sizeof(tsf_u32)));
+		if (!d) goto out_of_memory;
+		TSF_MEMSET(d, 0, sizeof(struct tsf_deferred_decode));
+		d->decoder = *decoder;
+		d->jobs = (struct tsf_decode_job*)(d + 1);
+		d->pcms = (struct tsf_pcm_range*)(d->jobs + hydra.shdrNum);
+		jobOut = (tsf_u32*)(d->pcms + hydra.shdrNum);
+		resNum = tsf_layout_sf3_samples(rawBuffer, smplCount, &hydra, decoder, d->jobs, jobOut, &d->jobNum, d->pcms, &d->pcmNum);
+		res = (tsf*)TSF_MALLOC(sizeof(tsf));
+		if (res) TSF_MEMSET(res, 0, sizeof(tsf));
+		if (!res || !tsf_load_presets(res, &hydra, resNum)) { TSF_FREE(d); goto out_of_memory; }
+		res->outSampleRate = 44100.0f;
+		res->effectBlockSamples = TSF_RENDER_EFFECTSAMPLEBLOCK;
+		res->deferredDecode = d;
+		d->rawBuffer = rawBuffer;
+		rawBuffer = TSF_NULL; // don't free below
+		res->fontSamples = (float*)TSF_MALLOC((resNum ? resNum : 1) * sizeof(float));
+		res->fontSampleNum = resNum;
+		res->lowpassTable = (float*)TSF_MALLOC(TSF_LOWPASS_TABLESIZE * sizeof(float));
+		if (!res->fontSamples || !res->lowpassTable) { tsf_close(res); res = TSF_NULL; }
+		else
+		{
+			for (i = 0; i != d->jobNum; i++) d->jobs[i].out = res->fontSamples + jobOut[i];
+			tsf_voice_lowpass_buildtable(res);
+		}
+	}
+	else if (source)
+	{
+		res = (tsf*)TSF_MALLOC(sizeof(tsf));
+		if (res) TSF_MEMSET(res, 0, sizeof(tsf));
+		if (!res || !tsf_load_presets(res, &hydra, smplCount)) goto out_of_memory;
+		res->outSampleRate = 44100.0f;
+		res->effectBlockSamples = TSF_RENDER_EFFECTSAMPLEBLOCK;
+		res->streamSource = *source;
+		res->streamSmplOffset = smplOffset;
+		res->streamSmplCount = smplCount;
+		res->lowpassTable = (float*)TSF_MALLOC(TSF_LOWPASS_TABLESIZE * sizeof(float));
+		if (!res->lowpassTable || !tsf_load_resident_samples(res, &hydra, smplCount, preloadSeconds)) { tsf_close(res); res = TSF_NULL; }
+		else tsf_voice_lowpass_buildtable(res);
+	}
 	else
 	{
 		#ifdef STB_VORBIS_INCLUDE_STB_VORBIS_H
-		if (!floatBuffer && !tsf_decode_sf3_samples(rawBuffer, &floatBuffer, &smplCount, &hydra)) goto out_of_memory;
+		if (!floatBuffer && !decoder && !tsf_decode_sf3_samples(rawBuffer, &floatBuffer, &smplCount, &hydra)) goto out_of_memory;
 		#endif
+		if (!floatBuffer && decoder && !tsf_decode_sf3_samples_with(rawBuffer, &floatBuffer, &smplCount, &hydra, decoder)) goto out_of_memory;
 		res = (tsf*)TSF_MALLOC(sizeof(tsf));
 		if (res) TSF_MEMSET(res, 0, sizeof(tsf));
 		if (!res || !tsf_load_presets(res, &hydra, smplCount)) goto out_of_memory;
 		res->outSampleRate = 44100.0f;
+		res->effectBlockSamples = TSF_RENDER_EFFECTSAMPLEBLOCK;
 		res->fontSamples = floatBuffer;
+		res->fontSampleNum = smplCount;
 		floatBuffer = TSF_NULL; // don't free below
+		res->lowpassTable = (float*)TSF_MALLOC(TSF_LOWPASS_TABLESIZE * sizeof(float));
+		if (!res->lowpassTable) { tsf_close(res); res = TSF_NULL; }
+		else tsf_voice_lowpass_buildtable(res);
 	}
 	if (0)
 	{
 		out_of_memory:
+		if (res) tsf_arena_free(res->arena);
 		TSF_FREE(res);
 		res = TSF_NULL;
 		//if (e) *e = TSF_OUT_OF_MEMORY;
 	}
-	TSF_FREE(hydra.phdrs); TSF_FREE(hydra.pbags); TSF_FREE(hydra.pmods);
-	TSF_FREE(hydra.pgens); TSF_FREE(hydra.insts); TSF_FREE(hydra.ibags);
-	TSF_FREE(hydra.imods); TSF_FREE(hydra.igens); TSF_FREE(hydra.shdrs);
-	TSF_FREE(rawBuffer);   TSF_FREE(floatBuffer);
+	tsf_arena_free(hydraArena);
+	TSF_FREE(hydraBuffer);
+	TSF_FREE(rawBuffer); TSF_FREE(floatBuffer);
+	return res;
+}
+
+TSFDEF tsf* tsf_load(struct tsf_stream* stream)
+{
+	return tsf_load_internal(stream, TSF_NULL, 0, TSF_FALSE, TSF_NULL);
+}
+
+TSFDEF tsf* tsf_load_with_decoder(struct tsf_stream* stream, const struct tsf_sample_decoder* decoder)
+{
+	if (!decoder || !decoder->get_length || !decoder->decode) return TSF_NULL;
+	return tsf_load_internal(stream, TSF_NULL, 0, TSF_FALSE, decoder);
+}
+
+TSFDEF tsf* tsf_load_streamed(struct tsf_stream* stream, const struct tsf_stream_source* source, float preload_seconds)
+{
+	if (!source || !source->read_at) return TSF_NULL;
+	return tsf_load_internal(stream, source, preload_seconds, TSF_FALSE, TSF_NULL);
+}
+
+TSFDEF tsf* tsf_load_deferred(struct tsf_stream* stream, const struct tsf_stream_source* source)
+{
+	if (!source || !source->read_at) return TSF_NULL;
+	return tsf_load_internal(stream, source, 0, TSF_TRUE, TSF_NULL);
+}
+
+TSFDEF tsf* tsf_load_deferred_with_decoder(struct tsf_stream* stream, const struct tsf_sample_decoder* decoder)
+{
+	if (!decoder || !decoder->get_length || !decoder->decode) return TSF_NULL;
+	return tsf_load_internal(stream, TSF_NULL, 0, TSF_TRUE, decoder);
+}
+
+// Second phase of tsf_load_deferred_with_decoder, converts the PCM ranges up to the next compressed
+// samples and decodes as many of those as fit in max_samples
+static int tsf_load_deferred_decode_step(tsf* f, int max_samples)
+{
+	struct tsf_deferred_decode* d = f->deferredDecode;
+	tsf_u32 budget = (max_samples > 0 ? (tsf_u32)max_samples : (tsf_u32)-1), done = 0, next;
+	int jobEnd = d->jobNext, i;
+
+	while (d->pcmNext != d->pcmNum && done < budget && (d->jobNext == d->jobNum || d->pcms[d->pcmNext].out < (tsf_u32)(d->jobs[d->jobNext].out - f->fontSamples)))
+	{
+		tsf_convert_pcm_range(d->rawBuffer, f->fontSamples, &d->pcms[d->pcmNext]);
+		done += d->pcms[d->pcmNext++].num;
+	}
+
+	// A batch of consecutive compressed samples, not interrupted by a PCM range
+	next = (d->pcmNext != d->pcmNum ? d->pcms[d->pcmNext].out : f->fontSampleNum);
+	while (jobEnd != d->jobNum && (tsf_u32)(d->jobs[jobEnd].out - f->fontSamples) < next && (jobEnd == d->jobNext ? done < budget || !done : done + d->jobs[jobEnd].length <= budget))
+		done += d->jobs[jobEnd++].length;
+	if (jobEnd != d->jobNext)
+	{
+		for (i = d->jobNext; i != jobEnd; i++) TSF_MEMSET(d->jobs[i].out + d->jobs[i].length, 0, 46 * sizeof(float));
+		if (!d->decoder.decode(d->decoder.data, d->jobs + d->jobNext, jobEnd - d->jobNext)) return -1;
+		d->jobNext = jobEnd;
+	}
+
+	// Everything before the next unprocessed job or range is in place
+	next = f->fontSampleNum;
+	if (d->jobNext != d->jobNum) next = (tsf_u32)(d->jobs[d->jobNext].out - f->fontSamples);
+	if (d->pcmNext != d->pcmNum && d->pcms[d->pcmNext].out < next) next = d->pcms[d->pcmNext].out;
+
+	// Publish the decoded samples before the renderer can see the new count
+	TSF_MEMORY_BARRIER();
+	f->fontSamplesLoaded = next;
+	if (next == f->fontSampleNum) { TSF_FREE(d->rawBuffer); d->rawBuffer = TSF_NULL; }
+	return (next != f->fontSampleNum);
+}
+
+TSFDEF int tsf_load_deferred_step(tsf* f, int max_samples)
+{
+	unsigned int start, num;
+	float *out, *outEnd;
+	const short* in;
+	if (!f || f->fontSamplesLoaded == f->fontSampleNum) return 0;
+	if (f->deferredDecode) return tsf_load_deferred_decode_step(f, max_samples);
+	if (!f->deferredSource.read_at) return 0;
+	start = f->fontSamplesLoaded;
+	num = f->fontSampleNum - start;
+	if (max_samples > 0 && num > (unsigned int)max_samples) num = (unsigned int)max_samples;
+
+	// Read into the float buffer and convert in place from the back, like tsf_load_resident_samples
+	out = f->fontSamples + start, outEnd = out + num, in = (const short*)out + num;
+	if (f->deferredSource.read_at(f->deferredSource.data, out, f->deferredSmplOffset + start * (unsigned int)sizeof(short), num * (unsigned int)sizeof(short)) != (int)(num * sizeof(short))) return -1;
+	while (outEnd != out) *(--outEnd) = (float)(*(--in) / 32767.0);
+
+	// Publish the converted samples before the renderer can see the new count
+	TSF_MEMORY_BARRIER();
+	f->fontSamplesLoaded = start + num;
+	return (f->fontSamplesLoaded != f->fontSampleNum);
+}
+
+static TSF_BOOL tsf_samples_pending(const tsf* f)
+{
+	return ((f->deferredSource.read_at || f->deferredDecode) && f->fontSamplesLoaded != f->fontSampleNum);
+}
+
+// A region reads its samples up to and including its end (or loop end) index
+static TSF_BOOL tsf_region_is_loaded(const tsf* f, const struct tsf_region* region)
+{
+	unsigned int loaded = f->fontSamplesLoaded, last = (region->loop_end > region->end ? region->loop_end : region->end);
+	return ((!f->deferredSource.read_at && !f->deferredDecode) || loaded == f->fontSampleNum || last + 1 < loaded);
+}
+
+TSFDEF int tsf_preset_is_loaded(const tsf* f, int preset_index)
+{
+	struct tsf_region *region, *regionEnd;
+	if (preset_index < 0 || preset_index >= f->presetNum) return 0;
+	for (region = f->presets[preset_index].regions, regionEnd = region + f->presets[preset_index].regionNum; region != regionEnd; region++)
+		if (!tsf_region_is_loaded(f, region)) return 0;
+	return 1;
+}
+
+// Halves the sample rate of 'in' with a zero-phase half-band filter, out[k] lines up with in[k * 2].
+static void tsf_mipmap_decimate(const float* in, unsigned int inNum, float* out, unsigned int outNum)
+{
+	static const float halfband[TSF_MIPMAP_TAPS] = { 0.313274088f, -0.091911008f, 0.042468063f, -0.020170805f, 0.008789360f, -0.003229000f, 0.000853940f, -0.000074639f };
+	unsigned int k, center, d;
+	int j;
+	for (k = 0; k != outNum; k++)
+	{
+		float sum;
+		center = k * 2;
+		sum = in[center] * 0.5f;
+		if (center >= TSF_MIPMAP_TAPS * 2 && center + TSF_MIPMAP_TAPS * 2 < inNum)
+		{
+			for (j = 0, d = 1; j != TSF_MIPMAP_TAPS; j++, d += 2)
+				sum += halfband[j] * (in[center - d] + in[center + d]);
+		}
+		else
+		{
+			// Treat data outside the buffer as silence
+			for (j = 0, d = 1; j != TSF_MIPMAP_TAPS; j++, d += 2)
+			{
+				if (center >= d) sum += halfband[j] * in[center - d];
+				if (center + d < inNum) sum += halfband[j] * in[center + d];
+			}
+		}
+		out[k] = sum;
+	}
+}
+
+// Sample of the signal a span is decimated from: the region's samples, the loop repeating past its end
+// or silence past the end
+static float tsf_mipspan_sample(const tsf* f, const struct tsf_mipspan* span, unsigned int index)
+{
+	if (span->loopStart != span->loopEnd)
+	{
+		if (index > span->loopEnd) index = span->loopStart + (index - span->loopStart) % (span->loopEnd - span->loopStart + 1);
+	}
+	else if (index >= span->end) return 0;
+	if (index < span->residentShift || index - span->residentShift >= f->fontSampleNum) return 0;
+	return f->fontSamples[index - span->residentShift];
+}
+
+// Length of that signal, so every level still holds the filter's reach past the last sample a voice reads
+static unsigned int tsf_mipspan_length(const struct tsf_mipspan* span, int levels)
+{
+	unsigned int last = (span->loopStart != span->loopEnd ? span->loopEnd + 1 + (span->loopEnd - span->loopStart + 1) : span->end);
+	return last - span->base + (TSF_MIPMAP_TAPS * 4 << levels);
+}
+
+TSFDEF int tsf_build_mipmaps(tsf* f, int levels)
+{
+	float* mips[TSF_MIPMAP_MAXLEVELS];
+	unsigned int tableNum[TSF_MIPMAP_MAXLEVELS], inNum, outNum, signalMax = 1, k;
+	struct tsf_mipspan *spans, *span, swap;
+	const float* in;
+	float* signal;
+	int level, i, j, gap, regionNum = 0, spanNum = 0;
+	if (!f || !f->fontSamples || tsf_samples_pending(f)) return 0;
+	if (f->mipLevels || levels <= 0) return 1;
+	if (f->refCount && *f->refCount > 1) return 0;
+	if (levels > TSF_MIPMAP_MAXLEVELS) levels = TSF_MIPMAP_MAXLEVELS;
+
+	// Collect the spans of all regions, sorted so duplicates are merged and voices find theirs with a binary search
+	for (i = 0; i != f->presetNum; i++) regionNum += f->presets[i].regionNum;
+	spans = (struct tsf_mipspan*)TSF_MALLOC((regionNum ? regionNum : 1) * sizeof(struct tsf_mipspan));
+	if (!spans) return 0;
+	for (i = 0; i != f->presetNum; i++)
+		for (j = 0; j != f->presets[i].regionNum; j++)
+			if (tsf_mipspan_key(&f->presets[i].regions[j], &spans[spanNum])) spanNum++;
+	for (gap = spanNum / 2; gap; gap /= 2)
+		for (i = gap; i < spanNum; i++)
+			for (j = i; j >= gap && tsf_mipspan_compare(&spans[j - gap], &spans[j]) > 0; j -= gap)
+				swap = spans[j], spans[j] = spans[j - gap], spans[j - gap] = swap;
+	for (i = j = 0; i != spanNum; i++)
+		if (!j || tsf_mipspan_compare(&spans[j - 1], &spans[i])) spans[j++] = spans[i];
+	spanNum = j;
+
+	// Place each span in the tables of all levels
+	TSF_MEMSET(tableNum, 0, sizeof(tableNum));
+	for (span = spans; span != spans + spanNum; span++)
+	{
+		span->base = (span->loopStart != span->loopEnd && span->loopStart < span->offset ? span->loopStart : span->offset);
+		inNum = tsf_mipspan_length(span, levels);
+		if (inNum > signalMax) signalMax = inNum;
+		for (level = 0; level != levels; level++)
+		{
+			inNum = (inNum + 1) / 2;
+			span->start[level] = tableNum[level];
+			tableNum[level] += inNum;
+		}
+	}
+	signal = (float*)TSF_MALLOC(signalMax * sizeof(float));
+	for (level = 0; level != levels; level++) mips[level] = (signal ? (float*)TSF_MALLOC((tableNum[level] ? tableNum[level] : 1) * sizeof(float)) : TSF_NULL);
+	for (level = 0; level != levels && mips[level]; level++) {}
+	if (level != levels)
+	{
+		for (level = 0; level != levels; level++) TSF_FREE(mips[level]);
+		TSF_FREE(signal);
+		TSF_FREE(spans);
+		return 0;
+	}
+
+	// Decimate each span from its own signal, each level from the one above it
+	for (span = spans; span != spans + spanNum; span++)
+	{
+		inNum = tsf_mipspan_length(span, levels);
+		for (k = 0; k != inNum; k++) signal[k] = tsf_mipspan_sample(f, span, span->base + k);
+		for (level = 0, in = signal; level != levels; in = mips[level] + span->start[level], level++, inNum = outNum)
+		{
+			outNum = (inNum + 1) / 2;
+			tsf_mipmap_decimate(in, inNum, mips[level] + span->start[level], outNum);
+		}
+	}
+	TSF_FREE(signal);
+
+	// Publish the tables before the level count that makes voices read them
+	for (level = 0; level != levels; level++) f->mipSamples[level] = mips[level];
+	f->mipSpans = spans;
+	f->mipSpanNum = spanNum;
+	TSF_MEMORY_BARRIER();
+	f->mipLevels = levels;
+	return 1;
+}
+
+// Layout of a cache image: header, presets (regions pointer unused), all regions in preset order, samples
+#define TSF_CACHE_VERSION 1
+#define TSF_CACHE_ALIGN 64
+struct tsf_cache_header
+{
+	tsf_fourcc id;
+	tsf_u32 version, presetSize, regionSize, presetNum, regionNum, sampleNum;
+	tsf_u32 presetOffset, regionOffset, sampleOffset, totalSize;
+};
+
+static int tsf_cache_layout(const tsf* f, struct tsf_cache_header* h)
+{
+	tsf_u64 regionOffset, sampleOffset, totalSize;
+	int i;
+	if (f->streamSource.read_at || tsf_samples_pending(f)) return 0;
+	TSF_MEMSET(h, 0, sizeof(*h));
+	TSF_MEMCPY(h->id, "TSFC", 4);
+	h->version = TSF_CACHE_VERSION;
+	h->presetSize = (tsf_u32)sizeof(struct tsf_preset);
+	h->regionSize = (tsf_u32)sizeof(struct tsf_region);
+	h->presetNum = (tsf_u32)f->presetNum;
+	for (i = 0; i != f->presetNum; i++) h->regionNum += (tsf_u32)f->presets[i].regionNum;
+	h->sampleNum = f->fontSampleNum;
+	h->presetOffset = (sizeof(*h) + TSF_CACHE_ALIGN - 1) & ~(TSF_CACHE_ALIGN - 1);
+	regionOffset = (h->presetOffset + (tsf_u64)h->presetNum * h->presetSize + TSF_CACHE_ALIGN - 1) & ~(tsf_u64)(TSF_CACHE_ALIGN - 1);
+	sampleOffset = (regionOffset + (tsf_u64)h->regionNum * h->regionSize + TSF_CACHE_ALIGN - 1) & ~(tsf_u64)(TSF_CACHE_ALIGN - 1);
+	totalSize = sampleOffset + (tsf_u64)h->sampleNum * sizeof(float);
+	if (totalSize > 0xFFFFFFFFu) return 0;
+	h->regionOffset = (tsf_u32)regionOffset;
+	h->sampleOffset = (tsf_u32)sampleOffset;
+	h->totalSize = (tsf_u32)totalSize;
+	return 1;
+}
+
+TSFDEF unsigned int tsf_cache_size(const tsf* f)
+{
+	struct tsf_cache_header h;
+	return (f && tsf_cache_layout(f, &h) ? h.totalSize : 0);
+}
+
+// Samples written per call, so a writer that wants to stop doesn't wait for all of them
+#define TSF_CACHE_WRITE_CHUNK 65536
+
+static int tsf_cache_write_padding(const struct tsf_cache_writer* writer, tsf_u32 count)
+{
+	static const char zeros[TSF_CACHE_ALIGN] = { 0 };
+	while (count)
+	{
+		tsf_u32 size = (count < TSF_CACHE_ALIGN ? count : TSF_CACHE_ALIGN);
+		if (!writer->write(writer->data, zeros, size)) return 0;
+		count -= size;
+	}
+	return 1;
+}
+
+TSFDEF int tsf_cache_write(const tsf* f, const struct tsf_cache_writer* writer)
+{
+	struct tsf_cache_header h;
+	struct tsf_preset preset;
+	const float* samples;
+	tsf_u32 remaining, chunk;
+	int i;
+	if (!f || !writer || !tsf_cache_layout(f, &h)) return 0;
+	if (!writer->write(writer->data, &h, sizeof(h)) || !tsf_cache_write_padding(writer, h.presetOffset - (tsf_u32)sizeof(h))) return 0;
+	for (i = 0; i != f->presetNum; i++)
+	{
+		TSF_MEMCPY(&preset, &f->presets[i], sizeof(preset));
+		preset.regions = TSF_NULL;
+		if (!writer->write(writer->data, &preset, sizeof(preset))) return 0;
+	}
+	if (!tsf_cache_write_padding(writer, h.regionOffset - h.presetOffset - h.presetNum * h.presetSize)) return 0;
+	for (i = 0; i != f->presetNum; i++)
+		if (f->presets[i].regionNum && !writer->write(writer->data, f->presets[i].regions, (unsigned int)f->presets[i].regionNum * (unsigned int)sizeof(struct tsf_region))) return 0;
+	if (!tsf_cache_write_padding(writer, h.sampleOffset - h.regionOffset - h.regionNum * h.regionSize)) return 0;
+	for (samples = f->fontSamples, remaining = h.sampleNum; remaining; samples += chunk, remaining -= chunk)
+	{
+		chunk = (remaining < TSF_CACHE_WRITE_CHUNK ? remaining : TSF_CACHE_WRITE_CHUNK);
+		if (!writer->write(writer->data, samples, chunk * (tsf_u32)sizeof(float))) return 0;
+	}
+	return 1;
+}
+
+TSFDEF tsf* tsf_load_cache(const void* buffer, unsigned int size)
+{
+	const char* in = (const char*)buffer;
+	struct tsf_cache_header h;
+	struct tsf_region *regions, *regionsEnd;
+	tsf* res;
+	tsf_u32 regionIndex = 0;
+	int i;
+
+	if (!buffer || size < sizeof(h)) return TSF_NULL;
+	TSF_MEMCPY(&h, in, sizeof(h));
+	if (!TSF_FourCCEquals(h.id, "TSFC") || h.version != TSF_CACHE_VERSION || h.totalSize != size) return TSF_NULL;
+	if (h.presetSize != sizeof(struct tsf_preset) || h.regionSize != sizeof(struct tsf_region)) return TSF_NULL;
+	if (h.presetOffset + (tsf_u64)h.presetNum * h.presetSize > h.regionOffset) return TSF_NULL;
+	if (h.regionOffset + (tsf_u64)h.regionNum * h.regionSize > h.sampleOffset) return TSF_NULL;
+	if (h.sampleOffset + (tsf_u64)h.sampleNum * sizeof(float) != h.totalSize) return TSF_NULL;
+
+	// Regions are read as they are, so make sure they can't point outside the samples
+	regions = (struct tsf_region*)(in + h.regionOffset);
+	for (regionsEnd = regions + h.regionNum; regions != regionsEnd; regions++)
+		if (regions->offset > h.sampleNum || regions->end > h.sampleNum || regions->loop_end > h.sampleNum || regions->streamStart)
+			return TSF_NULL;
+
+	res = (tsf*)TSF_MALLOC(sizeof(tsf));
+	if (!res) return TSF_NULL;
+	TSF_MEMSET(res, 0, sizeof(tsf));
+	res->presetNum = (int)h.presetNum;
+	res->presets = (struct tsf_preset*)tsf_arena_alloc(&res->arena, h.presetNum * sizeof(struct tsf_preset), 0);
+	res->lowpassTable = (float*)TSF_MALLOC(TSF_LOWPASS_TABLESIZE * sizeof(float));
+	if (!res->presets || !res->lowpassTable) { tsf_close(res); return TSF_NULL; }
+
+	// Only the preset table is copied, to point each preset at its regions in the image
+	TSF_MEMCPY(res->presets, in + h.presetOffset, h.presetNum * sizeof(struct tsf_preset));
+	regions = (struct tsf_region*)(in + h.regionOffset);
+	for (i = 0; i != res->presetNum; i++)
+	{
+		if (res->presets[i].regionNum < 0 || (tsf_u32)res->presets[i].regionNum > h.regionNum - regionIndex) { tsf_close(res); return TSF_NULL; }
+		res->presets[i].regions = regions + regionIndex;
+		regionIndex += (tsf_u32)res->presets[i].regionNum;
+	}
+
+	res->fontSamples = (float*)(in + h.sampleOffset);
+	res->fontSampleNum = h.sampleNum;
+	res->fontExternal = TSF_TRUE;
+	res->outSampleRate = 44100.0f;
+	res->effectBlockSamples = TSF_RENDER_EFFECTSAMPLEBLOCK;
+	tsf_voice_lowpass_buildtable(res);
 	return res;
 }
 
 TSFDEF tsf* tsf_copy(tsf* f)
 {
 	tsf* res;
-	if (!f) return TSF_NULL;
+	if (!f || tsf_samples_pending(f)) return TSF_NULL;
 	if (!f->refCount)
 	{
 		f->refCount = (int*)TSF_MALLOC(sizeof(int));
@@ -1468,6 +2627,11 @@ TSFDEF tsf* tsf_copy(tsf* f)
 	res = (tsf*)TSF_MALLOC(sizeof(tsf));
 	if (!res) return TSF_NULL;
 	TSF_MEMCPY(res, f, sizeof(tsf));
+	res->lowpassTable = (float*)TSF_MALLOC(TSF_LOWPASS_TABLESIZE * sizeof(float));
+	if (!res->lowpassTable) { TSF_FREE(res); return TSF_NULL; }
+	TSF_MEMCPY(res->lowpassTable, f->lowpassTable, TSF_LOWPASS_TABLESIZE * sizeof(float));
+	res->streamRings = TSF_NULL;
+	res->streamUnderruns = 0;
 	res->voices = TSF_NULL;
 	res->voiceNum = 0;
 	res->channels = TSF_NULL;
@@ -1477,27 +2641,53 @@ TSFDEF tsf* tsf_copy(tsf* f)
 
 TSFDEF void tsf_close(tsf* f)
 {
+	int i;
 	if (!f) return;
 	if (!f->refCount || !--(*f->refCount))
 	{
-		struct tsf_preset *preset = f->presets, *presetEnd = preset + f->presetNum;
-		for (; preset != presetEnd; preset++) TSF_FREE(preset->regions);
-		TSF_FREE(f->presets);
-		TSF_FREE(f->fontSamples);
+		tsf_arena_free(f->arena);
+		if (!f->fontExternal) TSF_FREE(f->fontSamples);
+		for (i = 0; i != f->mipLevels; i++) TSF_FREE(f->mipSamples[i]);
+		TSF_FREE(f->mipSpans);
+		if (f->deferredDecode) TSF_FREE(f->deferredDecode->rawBuffer);
+		TSF_FREE(f->deferredDecode);
 		TSF_FREE(f->refCount);
 	}
 	TSF_FREE(f->channels);
 	TSF_FREE(f->voices);
+	TSF_FREE(f->lowpassTable);
+	TSF_FREE(f->streamRings);
 	TSF_FREE(f);
 }
 
+static void tsf_channel_setdefaults(struct tsf_channel* c)
+{
+	c->presetIndex = c->bank = 0;
+	c->pitchWheel = c->midiPan = 8192;
+	c->midiVolume = c->midiExpression = 16383;
+	c->midiModWheel = c->midiPressure = 0;
+	c->midiRPN = 0xFFFF;
+	c->midiData = c->sustain = 0;
+	c->panOffset = 0.0f;
+	c->gainDB = 0.0f;
+	c->pitchRange = 2.0f;
+	c->tuning = 0.0f;
+	c->vibratoDepth = 0.0f;
+	c->pitchGlide = 0.0f;
+}
+
 TSFDEF void tsf_reset(tsf* f)
 {
 	struct tsf_voice *v = f->voices, *vEnd = v + f->voiceNum;
 	for (; v != vEnd; v++)
 		if (v->playingPreset != -1 && (v->ampenv.segment < TSF_SEGMENT_RELEASE || v->ampenv.parameters.release))
 			tsf_voice_endquick(f, v);
-	if (f->channels) { TSF_FREE(f->channels); f->channels = TSF_NULL; }
+	if (f->channels)
+	{
+		struct tsf_channel *c = f->channels->channels, *cEnd = c + f->channels->channelNum;
+		for (; c != cEnd; c++) tsf_channel_setdefaults(c);
+		f->channels->activeChannel = 0;
+	}
 }
 
 TSFDEF int tsf_get_presetindex(const tsf* f, int bank, int preset_number)
@@ -1520,6 +2710,11 @@ TSFDEF const char* tsf_get_presetname(const tsf* f, int preset)
 	return (preset < 0 || preset >= f->presetNum ? TSF_NULL : f->presets[preset].presetName);
 }
 
+TSFDEF int tsf_get_presetbank(const tsf* f, int preset)
+{
+	return (preset < 0 || preset >= f->presetNum ? 0 : f->presets[preset].bank);
+}
+
 TSFDEF const char* tsf_bank_get_presetname(const tsf* f, int bank, int preset_number)
 {
 	return tsf_get_presetname(f, tsf_get_presetindex(f, bank, preset_number));
@@ -1530,6 +2725,12 @@ TSFDEF void tsf_set_output(tsf* f, enum TSFOutputMode outputmode, int samplerate
 	f->outputmode = outputmode;
 	f->outSampleRate = (float)(samplerate >= 1 ? samplerate : 44100.0f);
 	f->globalGainDB = global_gain_db;
+	if (f->lowpassTableSampleRate != f->outSampleRate) tsf_voice_lowpass_buildtable(f);
+}
+
+TSFDEF void tsf_set_effect_block(tsf* f, int block_samples)
+{
+	f->effectBlockSamples = (block_samples < 1 ? 1 : (block_samples > TSF_RENDER_MAXEFFECTSAMPLEBLOCK ? TSF_RENDER_MAXEFFECTSAMPLEBLOCK : block_samples));
 }
 
 TSFDEF void tsf_set_volume(tsf* f, float global_volume)
@@ -1546,7 +2747,19 @@ TSFDEF int tsf_set_max_voices(tsf* f, int max_voices)
 	f->voices = newVoices;
 	f->voiceNum = f->maxVoiceNum = newVoiceNum;
 	for (; i < max_voices; i++)
+	{
+		TSF_MEMSET(&f->voices[i], 0, sizeof(struct tsf_voice));
 		f->voices[i].playingPreset = -1;
+	}
+	if (f->streamSource.read_at)
+	{
+		// Every voice gets its own ring buffer for streamed sample data
+		float* newRings = (float*)TSF_REALLOC(f->streamRings, newVoiceNum * TSF_STREAM_RINGSAMPLES * sizeof(float));
+		if (!newRings) return 0;
+		f->streamRings = newRings;
+		for (i = 0; i < newVoiceNum; i++)
+			f->voices[i].streamRing = newRings + i * TSF_STREAM_RINGSAMPLES;
+	}
 	return 1;
 }
 
@@ -1563,8 +2776,9 @@ TSFDEF int tsf_note_on(tsf* f, int preset_index, int key, float vel)
 	voicePlayIndex = f->voicePlayIndex++;
 	for (region = f->presets[preset_index].regions, regionEnd = region + f->presets[preset_index].regionNum; region != regionEnd; region++)
 	{
-		struct tsf_voice *voice, *v, *vEnd; TSF_BOOL doLoop; float lowpassFilterQDB, lowpassFc;
+		struct tsf_voice *voice, *v, *vEnd; TSF_BOOL doLoop; float lowpassFilterQDB;
 		if (key < region->lokey || key > region->hikey || midiVelocity < region->lovel || midiVelocity > region->hivel) continue;
+		if (!tsf_region_is_loaded(f, region)) continue;
 
 		voice = TSF_NULL, v = f->voices, vEnd = v + f->voiceNum;
 		if (region->group)
@@ -1607,6 +2821,7 @@ TSFDEF int tsf_note_on(tsf* f, int preset_index, int key, float vel)
 				if (!newVoices) return 0;
 				f->voices = newVoices;
 				voice = &f->voices[f->voiceNum - 4];
+				TSF_MEMSET(voice, 0, 4 * sizeof(struct tsf_voice));
 				voice[1].playingPreset = voice[2].playingPreset = voice[3].playingPreset = -1;
 			}
 		}
@@ -1617,6 +2832,9 @@ TSFDEF int tsf_note_on(tsf* f, int preset_index, int key, float vel)
 		voice->playIndex = voicePlayIndex;
 		voice->heldSustain = 0;
 		voice->noteGainDB = f->globalGainDB - region->attenuation - tsf_gainToDecibels(1.0f / vel);
+		voice->vibratoDepth = 0.0f;
+		voice->glideTimecents = 0.0;
+		voice->glideSamples = 0;
 
 		if (f->channels)
 		{
@@ -1631,7 +2849,11 @@ TSFDEF int tsf_note_on(tsf* f, int preset_index, int key, float vel)
 		}
 
 		// Offset/end.
-		voice->sourceSamplePosition = region->offset;
+		voice->sourceSamplePosition = (tsf_u64)region->offset << TSF_FIXED_SHIFT;
+		voice->controlValid = TSF_FALSE;
+		voice->mipLevel = 0;
+		voice->mipSpan = -2;
+		voice->loopWrapped = TSF_FALSE;
 
 		// Loop.
 		doLoop = (region->loop_mode != TSF_LOOPMODE_NONE && region->loop_start < region->loop_end);
@@ -1643,16 +2865,22 @@ TSFDEF int tsf_note_on(tsf* f, int preset_index, int key, float vel)
 		tsf_voice_envelope_setup(&voice->modenv, &region->modenv, key, midiVelocity, TSF_FALSE, f->outSampleRate);
 
 		// Setup lowpass filter.
-		lowpassFc = (region->initialFilterFc <= 13500 ? tsf_cents2Hertz((float)region->initialFilterFc) / f->outSampleRate : 1.0f);
 		lowpassFilterQDB = region->initialFilterQ / 10.0f;
-		voice->lowpass.QInv = 1.0 / TSF_POW(10.0, (lowpassFilterQDB / 20.0));
+		voice->lowpass.QInv = (float)(1.0 / TSF_POW(10.0, (lowpassFilterQDB / 20.0)));
 		voice->lowpass.z1 = voice->lowpass.z2 = 0;
-		voice->lowpass.active = (lowpassFc < 0.499f);
-		if (voice->lowpass.active) tsf_voice_lowpass_setup(&voice->lowpass, lowpassFc);
+		tsf_voice_lowpass_setup(f, &voice->lowpass, (float)region->initialFilterFc);
 
 		// Setup LFO filters.
 		tsf_voice_lfo_setup(&voice->modlfo, region->delayModLFO, region->freqModLFO, f->outSampleRate);
 		tsf_voice_lfo_setup(&voice->viblfo, region->delayVibLFO, region->freqVibLFO, f->outSampleRate);
+
+		// Hand the voice to tsf_stream_service if its sample continues on disk.
+		if (region->streamStart)
+		{
+			voice->streamReadPos = region->offset;
+			TSF_MEMORY_BARRIER();
+			voice->streamRequest++;
+		}
 	}
 	return 1;
 }
@@ -1707,6 +2935,57 @@ TSFDEF int tsf_active_voice_count(tsf* f)
 	return count;
 }
 
+TSFDEF int tsf_stream_service(tsf* f)
+{
+	short chunk[TSF_STREAM_READSAMPLES];
+	struct tsf_voice *v, *vEnd = f->voices + f->voiceNum;
+	int streaming = 0;
+	if (!f->streamSource.read_at) return 0;
+	for (v = f->voices; v != vEnd; v++)
+	{
+		struct tsf_region* region;
+		unsigned int request, next, end, limit;
+		if (!v->streamRing || v->playingPreset == -1) continue;
+		request = v->streamRequest;
+		TSF_MEMORY_BARRIER();
+		region = v->region;
+		if (!region || !region->streamStart) continue;
+		if (v->streamServed != request)
+		{
+			// New note on this voice, streaming continues where its resident samples end
+			v->streamEnd = region->streamStart;
+			TSF_MEMORY_BARRIER();
+			v->streamServed = request;
+		}
+		streaming++;
+
+		// Read up to the loop end while looping, otherwise to the sample end, but never
+		// overwrite ring entries the voice hasn't played yet.
+		next = v->streamEnd;
+		end = (v->loopStart < v->loopEnd ? v->loopEnd : region->end) + 1;
+		limit = v->streamReadPos + TSF_STREAM_RINGSAMPLES;
+		if (end > limit) end = limit;
+		if (end > f->streamSmplCount) end = f->streamSmplCount;
+		while (next < end)
+		{
+			unsigned int count = (end - next > TSF_STREAM_READSAMPLES ? TSF_STREAM_READSAMPLES : end - next), i;
+			if (f->streamSource.read_at(f->streamSource.data, chunk, f->streamSmplOffset + next * (unsigned int)sizeof(short), count * (unsigned int)sizeof(short)) != (int)(count * sizeof(short))) break;
+			for (i = 0; i != count; i++)
+				v->streamRing[(next + i) & (TSF_STREAM_RINGSAMPLES - 1)] = (float)(chunk[i] / 32767.0);
+			next += count;
+			TSF_MEMORY_BARRIER();
+			if (v->streamRequest != request) break;
+			v->streamEnd = next;
+		}
+	}
+	return streaming;
+}
+
+TSFDEF unsigned int tsf_stream_get_underruns(const tsf* f)
+{
+	return f->streamUnderruns;
+}
+
 TSFDEF void tsf_render_short(tsf* f, short* buffer, int samples, int flag_mixing)
 {
 	float outputSamples[TSF_RENDER_SHORTBUFFERBLOCK];
@@ -1735,13 +3014,47 @@ TSFDEF void tsf_render_short(tsf* f, short* buffer, int samples, int flag_mixing
 	}
 }
 
+static void tsf_render_lanes(tsf* f, struct tsf_voice** laneVoice, const int* laneSamples, const float* laneGain, const float* laneGainStep, int laneCount, float* scratch, int blockSamples, float* buffer, int offset, int bufferSamples)
+{
+	int lane;
+	tsf_voice_lowpass_process_lanes(laneVoice, laneCount, scratch, blockSamples);
+	for (lane = 0; lane != laneCount; lane++)
+		tsf_voice_mix(f, laneVoice[lane], scratch + lane, TSF_LOWPASS_LANES, laneSamples[lane], laneGain[lane], laneGainStep[lane], buffer, offset, bufferSamples);
+}
+
 TSFDEF void tsf_render_float(tsf* f, float* buffer, int samples, int flag_mixing)
 {
-	struct tsf_voice *v = f->voices, *vEnd = v + f->voiceNum;
+	// Voices are rendered one effect block at a time. Each voice renders into a lane of the
+	// scratch block; unfiltered voices are mixed straight away while filtered ones are
+	// collected until all lanes are in use and then filtered together.
+	float scratch[TSF_RENDER_MAXEFFECTSAMPLEBLOCK * TSF_LOWPASS_LANES], laneGain[TSF_LOWPASS_LANES], laneGainStep[TSF_LOWPASS_LANES], gainMono, gainStep;
+	struct tsf_voice *laneVoice[TSF_LOWPASS_LANES], *v, *vEnd = f->voices + f->voiceNum;
+	int laneSamples[TSF_LOWPASS_LANES], laneCount, offset, blockSamples, numSamples;
+
 	if (!flag_mixing) TSF_MEMSET(buffer, 0, (f->outputmode == TSF_MONO ? 1 : 2) * sizeof(float) * samples);
-	for (; v != vEnd; v++)
-		if (v->playingPreset != -1)
-			tsf_voice_render(f, v, buffer, samples);
+	TSF_MEMSET(scratch, 0, sizeof(scratch));
+
+	for (offset = 0; offset < samples; offset += blockSamples)
+	{
+		blockSamples = (samples - offset > f->effectBlockSamples ? f->effectBlockSamples : samples - offset);
+		for (v = f->voices, laneCount = 0; v != vEnd; v++)
+		{
+			if (v->playingPreset == -1) continue;
+			numSamples = tsf_voice_render(f, v, scratch + laneCount, TSF_LOWPASS_LANES, blockSamples, &gainMono, &gainStep);
+			if (!v->lowpass.active)
+			{
+				tsf_voice_mix(f, v, scratch + laneCount, TSF_LOWPASS_LANES, numSamples, gainMono, gainStep, buffer, offset, samples);
+				continue;
+			}
+			laneVoice[laneCount] = v, laneSamples[laneCount] = numSamples, laneGain[laneCount] = gainMono, laneGainStep[laneCount] = gainStep;
+			if (++laneCount == TSF_LOWPASS_LANES)
+			{
+				tsf_render_lanes(f, laneVoice, laneSamples, laneGain, laneGainStep, laneCount, scratch, blockSamples, buffer, offset, samples);
+				laneCount = 0;
+			}
+		}
+		if (laneCount) tsf_render_lanes(f, laneVoice, laneSamples, laneGain, laneGainStep, laneCount, scratch, blockSamples, buffer, offset, samples);
+	}
 }
 
 static void tsf_channel_setup_voice(tsf* f, struct tsf_voice* v)
@@ -1750,6 +3063,7 @@ static void tsf_channel_setup_voice(tsf* f, struct tsf_voice* v)
 	float newpan = v->region->pan + c->panOffset;
 	v->playingChannel = f->channels->activeChannel;
 	v->noteGainDB += c->gainDB;
+	v->vibratoDepth = c->vibratoDepth;
 	tsf_voice_calcpitchratio(v, (c->pitchWheel == 8192 ? c->tuning : ((c->pitchWheel / 16383.0f * c->pitchRange * 2.0f) - c->pitchRange + c->tuning)), f->outSampleRate);
 	if      (newpan <= -0.5f) { v->panFactorLeft = 1.0f; v->panFactorRight = 0.0f; }
 	else if (newpan >=  0.5f) { v->panFactorLeft = 0.0f; v->panFactorRight = 1.0f; }
@@ -1777,28 +3091,42 @@ static struct tsf_channel* tsf_channel_init(tsf* f, int channel)
 	i = f->channels->channelNum;
 	f->channels->channelNum = channel + 1;
 	for (; i <= channel; i++)
-	{
-		struct tsf_channel* c = &f->channels->channels[i];
-		c->presetIndex = c->bank = 0;
-		c->pitchWheel = c->midiPan = 8192;
-		c->midiVolume = c->midiExpression = 16383;
-		c->midiRPN = 0xFFFF;
-		c->midiData = c->sustain = 0;
-		c->panOffset = 0.0f;
-		c->gainDB = 0.0f;
-		c->pitchRange = 2.0f;
-		c->tuning = 0.0f;
-	}
+		tsf_channel_setdefaults(&f->channels->channels[i]);
 	return &f->channels->channels[channel];
 }
 
+TSFDEF int tsf_set_max_channels(tsf* f, int channel_count)
+{
+	return (channel_count <= 0 || tsf_channel_init(f, channel_count - 1) != TSF_NULL);
+}
+
 static void tsf_channel_applypitch(tsf* f, int channel, struct tsf_channel* c)
 {
 	struct tsf_voice *v, *vEnd;
 	float pitchShift = (c->pitchWheel == 8192 ? c->tuning : ((c->pitchWheel / 16383.0f * c->pitchRange * 2.0f) - c->pitchRange + c->tuning));
+	int glideSamples = (int)(c->pitchGlide * f->outSampleRate);
 	for (v = f->voices, vEnd = v + f->voiceNum; v != vEnd; v++)
 		if (v->playingPreset != -1 && v->playingChannel == channel)
+		{
+			double previousTimecents = v->pitchInputTimecents;
 			tsf_voice_calcpitchratio(v, pitchShift, f->outSampleRate);
+			if (glideSamples <= 0) continue;
+			// Start from the pitch the voice is sounding now, including what is left of an earlier glide
+			v->glideTimecents += previousTimecents - v->pitchInputTimecents;
+			v->glideSamples = glideSamples;
+		}
+}
+
+static void tsf_channel_applyvibrato(tsf* f, int channel, struct tsf_channel* c)
+{
+	// SF2 default modulators: mod wheel and channel pressure each add up to 50 cents of vibrato LFO pitch depth
+	struct tsf_voice *v, *vEnd;
+	float vibratoDepth = (c->midiModWheel / 16383.0f + c->midiPressure / 127.0f) * 50.0f;
+	if (vibratoDepth == c->vibratoDepth) return;
+	c->vibratoDepth = vibratoDepth;
+	for (v = f->voices, vEnd = v + f->voiceNum; v != vEnd; v++)
+		if (v->playingPreset != -1 && v->playingChannel == channel)
+			v->vibratoDepth = vibratoDepth;
 }
 
 TSFDEF int tsf_channel_set_presetindex(tsf* f, int channel, int preset_index)
@@ -1856,6 +3184,7 @@ TSFDEF int tsf_channel_set_pan(tsf* f, int channel, float pan)
 	struct tsf_voice *v, *vEnd;
 	struct tsf_channel *c = tsf_channel_init(f, channel);
 	if (!c) return 0;
+	if (c->panOffset == pan - 0.5f) return 1;
 	for (v = f->voices, vEnd = v + f->voiceNum; v != vEnd; v++)
 		if (v->playingPreset != -1 && v->playingChannel == channel)
 		{
@@ -1912,6 +3241,14 @@ TSFDEF int tsf_channel_set_tuning(tsf* f, int channel, float tuning)
 	return 1;
 }
 
+TSFDEF int tsf_channel_set_pitchglide(tsf* f, int channel, float glide_seconds)
+{
+	struct tsf_channel *c = tsf_channel_init(f, channel);
+	if (!c) return 0;
+	c->pitchGlide = (glide_seconds > 0.0f ? glide_seconds : 0.0f);
+	return 1;
+}
+
 TSFDEF int tsf_channel_set_sustain(tsf* f, int channel, int flag_sustain)
 {
 	struct tsf_channel *c = tsf_channel_init(f, channel);
@@ -1928,6 +3265,26 @@ TSFDEF int tsf_channel_set_sustain(tsf* f, int channel, int flag_sustain)
 	return 1;
 }
 
+TSFDEF int tsf_channel_set_modwheel(tsf* f, int channel, int mod_wheel)
+{
+	struct tsf_channel *c = tsf_channel_init(f, channel);
+	if (!c) return 0;
+	if (c->midiModWheel == mod_wheel) return 1;
+	c->midiModWheel = (unsigned short)mod_wheel;
+	tsf_channel_applyvibrato(f, channel, c);
+	return 1;
+}
+
+TSFDEF int tsf_channel_set_pressure(tsf* f, int channel, int pressure)
+{
+	struct tsf_channel *c = tsf_channel_init(f, channel);
+	if (!c) return 0;
+	if (c->midiPressure == pressure) return 1;
+	c->midiPressure = (unsigned short)pressure;
+	tsf_channel_applyvibrato(f, channel, c);
+	return 1;
+}
+
 TSFDEF int tsf_channel_note_on(tsf* f, int channel, int key, float vel)
 {
 	if (!f->channels || channel >= f->channels->channelNum) return 1;
@@ -1996,6 +3353,8 @@ TSFDEF int tsf_channel_midi_control(tsf* f, int channel, int controller, int con
 		case  42 /*PAN_LSB*/         : c->midiPan        = (unsigned short)((c->midiPan        & 0x3F80) |  control_value);       goto TCMC_SET_PAN;
 		case   6 /*DATA_ENTRY_MSB*/  : c->midiData       = (unsigned short)((c->midiData       & 0x7F)   | (control_value << 7)); goto TCMC_SET_DATA;
 		case  38 /*DATA_ENTRY_LSB*/  : c->midiData       = (unsigned short)((c->midiData       & 0x3F80) |  control_value);       goto TCMC_SET_DATA;
+		case   1 /*MODULATION_MSB*/  : return tsf_channel_set_modwheel(f, channel, (c->midiModWheel & 0x7F  ) | (control_value << 7));
+		case  33 /*MODULATION_LSB*/  : return tsf_channel_set_modwheel(f, channel, (c->midiModWheel & 0x3F80) |  control_value);
 		case   0 /*BANK_SELECT_MSB*/ : c->bank = (unsigned short)(0x8000 | control_value); return 1; //bank select MSB alone acts like LSB
 		case  32 /*BANK_SELECT_LSB*/ : c->bank = (unsigned short)((c->bank & 0x8000 ? ((c->bank & 0x7F) << 7) : 0) | control_value); return 1;
 		case 101 /*RPN_MSB*/         : c->midiRPN = (unsigned short)(((c->midiRPN == 0xFFFF ? 0 : c->midiRPN) & 0x7F  ) | (control_value << 7)); return 1;
@@ -2015,6 +3374,8 @@ TSFDEF int tsf_channel_midi_control(tsf* f, int channel, int controller, int con
 			tsf_channel_set_pan(f, channel, 0.5f);
 			tsf_channel_set_pitchrange(f, channel, 2.0f);
 			tsf_channel_set_tuning(f, channel, 0);
+			tsf_channel_set_modwheel(f, channel, 0);
+			tsf_channel_set_pressure(f, channel, 0);
 			return 1;
 	}
 	return 1;